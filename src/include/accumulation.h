@@ -0,0 +1,125 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "raylib.h"
+
+namespace tracer {
+
+	// Classes //
+	// Linear HDR running sums behind the display buffer. Each pixel keeps its own sample
+	// count in w, so passes that only touch part of the frame still average correctly,
+	// and a sum of squared luminance for its variance. The first sample of a pixel also
+	// stores the distance and normal it hit, which is what reprojection validates against.
+	class AccumulationBuffer {
+		public:
+			int width;
+			int height;
+			int passes;
+			std::vector<Vector4> pixels;   // xyz radiance sum, w sample count
+			std::vector<float> squares;    // luminance squared sum
+			std::vector<float> depth;      // distance from the camera to the pixel center hit, INFINITY for sky
+			std::vector<Vector3> normals;
+
+			AccumulationBuffer();
+			~AccumulationBuffer();
+
+			void toDefault();
+			void reset(int width, int height);
+
+			void add(int x, int y, Vector3 radiance);
+			void setSurface(int x, int y, float distance, Vector3 normal);
+			// starts an empty pixel from a history estimate worth weight samples
+			void seed(int x, int y, Vector3 mean, float meanSquare, float weight);
+			Vector3 mean(int x, int y);
+			int samples(int x, int y);
+			float relativeError(int x, int y);
+			size_t memoryUsage();
+	};
+
+	AccumulationBuffer::AccumulationBuffer() {
+		this->toDefault();
+	};
+
+	AccumulationBuffer::~AccumulationBuffer() {
+
+	};
+
+	void AccumulationBuffer::toDefault() {
+		this->width = 0;
+		this->height = 0;
+		this->passes = 0;
+		this->pixels.clear();
+		this->squares.clear();
+		this->depth.clear();
+		this->normals.clear();
+	};
+
+	void AccumulationBuffer::reset(int width, int height) {
+		this->width = width;
+		this->height = height;
+		this->passes = 0;
+		this->pixels.assign((size_t) width * height, { 0.0f, 0.0f, 0.0f, 0.0f });
+		this->squares.assign((size_t) width * height, 0.0f);
+		this->depth.assign((size_t) width * height, INFINITY);
+		this->normals.assign((size_t) width * height, { 0.0f, 0.0f, 0.0f });
+	};
+
+	inline float luminance(Vector3 radiance) {
+		return 0.2126f * radiance.x + 0.7152f * radiance.y + 0.0722f * radiance.z;
+	}
+
+	void AccumulationBuffer::add(int x, int y, Vector3 radiance) {
+		float l = luminance(radiance);
+		this->squares[(size_t) y * this->width + x] += l * l;
+		Vector4* pixel = &this->pixels[(size_t) y * this->width + x];
+		pixel->x += radiance.x;
+		pixel->y += radiance.y;
+		pixel->z += radiance.z;
+		pixel->w += 1.0f;
+	};
+
+	void AccumulationBuffer::setSurface(int x, int y, float distance, Vector3 normal) {
+		this->depth[(size_t) y * this->width + x] = distance;
+		this->normals[(size_t) y * this->width + x] = normal;
+	};
+
+	void AccumulationBuffer::seed(int x, int y, Vector3 mean, float meanSquare, float weight) {
+		size_t index = (size_t) y * this->width + x;
+		this->pixels[index] = { mean.x * weight, mean.y * weight, mean.z * weight, weight };
+		this->squares[index] = meanSquare * weight;
+	};
+
+	Vector3 AccumulationBuffer::mean(int x, int y) {
+		const Vector4& pixel = this->pixels[(size_t) y * this->width + x];
+		if (pixel.w <= 0.0f) {
+			return { 0.0f, 0.0f, 0.0f };
+		}
+		float scale = 1.0f / pixel.w;
+		return { pixel.x * scale, pixel.y * scale, pixel.z * scale };
+	};
+
+	int AccumulationBuffer::samples(int x, int y) {
+		return (int) this->pixels[(size_t) y * this->width + x].w;
+	};
+
+	// standard error of the mean luminance relative to the mean itself, with a floor so
+	// near black pixels are not chased forever. Infinite below two samples.
+	float AccumulationBuffer::relativeError(int x, int y) {
+		size_t index = (size_t) y * this->width + x;
+		const Vector4& pixel = this->pixels[index];
+		float n = pixel.w;
+		if (n < 2.0f) {
+			return INFINITY;
+		}
+		float mean = luminance({ pixel.x / n, pixel.y / n, pixel.z / n });
+		float variance = std::max(0.0f, (this->squares[index] - n * mean * mean) / (n - 1.0f));
+		return std::sqrt(variance / n) / std::max(mean, 0.01f);
+	};
+
+	size_t AccumulationBuffer::memoryUsage() {
+		return this->pixels.size() * sizeof(Vector4) + (this->squares.size() + this->depth.size()) * sizeof(float) + this->normals.size() * sizeof(Vector3);
+	};
+
+};
@@ -0,0 +1,412 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "raylib.h"
+#include "mathlib.h"
+#include "jobs.h"
+#include "scene.h"
+#include "camera.h"
+#include "renderer.h"
+#include "image_writer.h"
+
+namespace tracer {
+
+	// Structs //
+	struct Keyframe {
+		float time;              // seconds
+		mathlib::CFrame* cframe;
+	};
+
+	struct SequenceStats {
+		int frames;
+		double wallSeconds;
+		double traceSeconds;   // summed over frames, on the calling thread's clock
+		double setupSeconds;   // summed, overlapped with tracing
+		double writeSeconds;   // summed, on the I/O thread
+	};
+
+	// Classes //
+	// Camera keyframes in time order, interpolated between neighbours (positions linearly,
+	// rotations along the shortest arc) and held at either end. A path with a closed form,
+	// such as the default orbit, sets curve instead and is evaluated exactly.
+	class CameraPath {
+		public:
+			std::vector<Keyframe> keyframes;
+			std::function<mathlib::CFrame*(float)> curve;   // a new CFrame at a time, replaces the keyframes when set
+			float curveDuration;
+
+			CameraPath();
+			~CameraPath();
+
+			// takes ownership of cframe
+			void add(float time, mathlib::CFrame* cframe);
+			float duration();
+			// a new CFrame the caller deletes, NULL without keyframes
+			mathlib::CFrame* evaluate(float time);
+			// one keyframe per line, "time px py pz tx ty tz" looking from p at t, # comments
+			bool load(const std::string& path);
+	};
+
+	// Renders frames of an animation as a pipeline of three stages that overlap:
+	//   setup of frame n + 1 (scene animation, refit, camera) runs as a job next to the
+	//   tiles of frame n, and frame n - 1 is encoded and written on an I/O thread.
+	// Setup needs a scene nobody is tracing, so there are two copies of the scene that
+	// frames alternate between, and two frame buffers for the tracer and the writer.
+	class SequenceRenderer {
+		public:
+			TileRenderer* renderer;
+			CameraPath* path;
+			Scene* scenes[2];
+			float framesPerSecond;
+			// moves a scene to its pose at a time, NULL for a static scene
+			std::function<void(Scene*, float)> animate;
+			SequenceStats stats;
+
+			SequenceRenderer(TileRenderer* renderer, CameraPath* path, Scene* first, Scene* second);
+			~SequenceRenderer();
+
+			// pattern is a printf pattern for the frame number such as "frame_%04d.ppm",
+			// false when a frame could not be written
+			bool render(int frameCount, int width, int height, const std::string& pattern);
+
+		private:
+			void setup(int frame, const RenderCamera& base, RenderCamera* camera);
+	};
+
+	// Methods //
+	// a circle around center at height above it, starting and ending in the same place
+	CameraPath* orbitPath(Vector3 center, float radius, float height, float duration);
+	// a new CFrame at position looking at target, y up
+	mathlib::CFrame* lookAt(Vector3 position, Vector3 target);
+	// inserts "_%04d" before the extension of a plain file name, patterns are left alone
+	std::string framePattern(const std::string& output);
+	// whether pattern holds exactly one %d, %Nd or %0Nd and no other conversion but %%,
+	// so it can go to string_format with a frame number
+	bool isFramePattern(const std::string& pattern);
+
+	// CameraPath //
+	CameraPath::CameraPath() {
+		this->curve = NULL;
+		this->curveDuration = 0.0f;
+	};
+
+	CameraPath::~CameraPath() {
+		for (Keyframe& keyframe : this->keyframes) {
+			delete(keyframe.cframe);
+		}
+	};
+
+	void CameraPath::add(float time, mathlib::CFrame* cframe) {
+		Keyframe keyframe = { time, cframe };
+		auto at = std::upper_bound(this->keyframes.begin(), this->keyframes.end(), time, [](float t, const Keyframe& k) {
+			return t < k.time;
+		});
+		this->keyframes.insert(at, keyframe);
+	};
+
+	float CameraPath::duration() {
+		if (this->curve) {
+			return this->curveDuration;
+		}
+		return this->keyframes.empty() ? 0.0f : this->keyframes.back().time;
+	};
+
+	// CFrame::lerp allocates a chain of intermediate CFrames it never frees, so the
+	// rotations are blended here as quaternions and only the result is allocated
+	mathlib::CFrame* CameraPath::evaluate(float time) {
+		if (this->curve) {
+			return this->curve(time);
+		}
+		if (this->keyframes.empty()) {
+			return NULL;
+		}
+		const Keyframe& first = this->keyframes.front();
+		const Keyframe& last = this->keyframes.back();
+		const Keyframe& held = time <= first.time || this->keyframes.size() == 1 ? first : last;
+		if (time <= first.time || time >= last.time || this->keyframes.size() == 1) {
+			mathlib::CFrameComponents c = held.cframe->components();
+			return new mathlib::CFrame(c.x, c.y, c.z, c.m11, c.m12, c.m13, c.m21, c.m22, c.m23, c.m31, c.m32, c.m33);
+		}
+		size_t next = 1;
+		while (this->keyframes[next].time < time) {
+			next++;
+		}
+		const Keyframe& a = this->keyframes[next - 1];
+		const Keyframe& b = this->keyframes[next];
+		float t = b.time > a.time ? (time - a.time) / (b.time - a.time) : 1.0f;
+
+		mathlib::Quaternion4 qa = mathlib::CFrame::quaternionFromCFrame(a.cframe);
+		mathlib::Quaternion4 qb = mathlib::CFrame::quaternionFromCFrame(b.cframe);
+		float cosine = qa.w * qb.w + qa.i * qb.i + qa.j * qb.j + qa.k * qb.k;
+		if (cosine < 0.0f) {
+			qb = { -qb.w, -qb.i, -qb.j, -qb.k };
+			cosine = -cosine;
+		}
+		float wa = 1.0f - t;
+		float wb = t;
+		if (cosine < 0.9995f) {
+			float theta = std::acos(cosine);
+			float sine = std::sin(theta);
+			wa = std::sin((1.0f - t) * theta) / sine;
+			wb = std::sin(t * theta) / sine;
+		}
+		mathlib::Quaternion4 q = { wa * qa.w + wb * qb.w, wa * qa.i + wb * qb.i, wa * qa.j + wb * qb.j, wa * qa.k + wb * qb.k };
+		float length = std::sqrt(q.w * q.w + q.i * q.i + q.j * q.j + q.k * q.k);
+		return new mathlib::CFrame(
+			a.cframe->x + (b.cframe->x - a.cframe->x) * t,
+			a.cframe->y + (b.cframe->y - a.cframe->y) * t,
+			a.cframe->z + (b.cframe->z - a.cframe->z) * t,
+			q.i / length, q.j / length, q.k / length, q.w / length
+		);
+	};
+
+	bool CameraPath::load(const std::string& path) {
+		std::ifstream file(path);
+		if (!file) {
+			std::cerr << "could not open camera path " << path << std::endl;
+			return false;
+		}
+		std::string line;
+		int number = 0;
+		while (std::getline(file, line)) {
+			number++;
+			size_t comment = line.find('#');
+			if (comment != std::string::npos) {
+				line.erase(comment);
+			}
+			std::istringstream fields(line);
+			float time, px, py, pz, tx, ty, tz;
+			if (!(fields >> time)) {
+				continue; // blank
+			}
+			if (!(fields >> px >> py >> pz >> tx >> ty >> tz)) {
+				std::cerr << path << ":" << number << ": expected time px py pz tx ty tz" << std::endl;
+				return false;
+			}
+			this->add(time, lookAt({ px, py, pz }, { tx, ty, tz }));
+		}
+		if (this->keyframes.empty()) {
+			std::cerr << "no keyframes in " << path << std::endl;
+			return false;
+		}
+		return true;
+	};
+
+	// evaluated on the circle itself, interpolating keyframes would cut its corners
+	CameraPath* orbitPath(Vector3 center, float radius, float height, float duration) {
+		CameraPath* path = new CameraPath();
+		path->curveDuration = duration;
+		path->curve = [center, radius, height, duration](float time) {
+			float t = duration > 0.0f ? std::min(std::max(time / duration, 0.0f), 1.0f) : 0.0f;
+			float angle = t * 2.0f * PI;
+			Vector3 position = { center.x + std::sin(angle) * radius, center.y + height, center.z + std::cos(angle) * radius };
+			return lookAt(position, center);
+		};
+		return path;
+	}
+
+	// the same frame as CFrame(position, lookAt), without the temporaries it allocates
+	mathlib::CFrame* lookAt(Vector3 position, Vector3 target) {
+		Vector3 back = geometry::normalize(geometry::sub(position, target));
+		Vector3 right = geometry::cross({ 0.0f, 1.0f, 0.0f }, back);
+		if (geometry::dot(right, right) == 0.0f) {
+			// straight up or down, the same fallback as CFrame
+			return back.y < 0.0f
+				? new mathlib::CFrame(position.x, position.y, position.z, 0, 1, 0, 0, 0, -1, -1, 0, 0)
+				: new mathlib::CFrame(position.x, position.y, position.z, 0, 1, 0, 0, 0, 1, 1, 0, 0);
+		}
+		right = geometry::normalize(right);
+		Vector3 up = geometry::cross(back, right);
+		return new mathlib::CFrame(position.x, position.y, position.z,
+			right.x, up.x, back.x,
+			right.y, up.y, back.y,
+			right.z, up.z, back.z);
+	}
+
+	std::string framePattern(const std::string& output) {
+		if (output.find('%') != std::string::npos) {
+			return output;
+		}
+		size_t dot = output.find_last_of('.');
+		size_t slash = output.find_last_of("/\\");
+		if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+			return output + "_%04d";
+		}
+		return output.substr(0, dot) + "_%04d" + output.substr(dot);
+	}
+
+	bool isFramePattern(const std::string& pattern) {
+		int conversions = 0;
+		for (size_t i = 0; i < pattern.size(); i++) {
+			if (pattern[i] != '%') {
+				continue;
+			}
+			i++;
+			if (i < pattern.size() && pattern[i] == '%') {
+				continue;
+			}
+			// a width of at most two digits, zero padded or not
+			size_t digits = 0;
+			while (i < pattern.size() && pattern[i] >= '0' && pattern[i] <= '9' && digits < 2) {
+				i++;
+				digits++;
+			}
+			if (i >= pattern.size() || pattern[i] != 'd') {
+				return false;
+			}
+			conversions++;
+		}
+		return conversions == 1;
+	}
+
+	// SequenceRenderer //
+	// first and second are two separately built copies of the same scene
+	SequenceRenderer::SequenceRenderer(TileRenderer* renderer, CameraPath* path, Scene* first, Scene* second) {
+		this->renderer = renderer;
+		this->path = path;
+		this->scenes[0] = first;
+		this->scenes[1] = second;
+		this->framesPerSecond = 24.0f;
+		this->animate = NULL;
+		this->stats = { 0, 0.0, 0.0, 0.0, 0.0 };
+	};
+
+	SequenceRenderer::~SequenceRenderer() {
+
+	};
+
+	// base carries what the path does not set, such as the field of view
+	void SequenceRenderer::setup(int frame, const RenderCamera& base, RenderCamera* camera) {
+		float time = (float) frame / this->framesPerSecond;
+		if (this->animate) {
+			this->animate(this->scenes[frame & 1], time);
+		}
+		mathlib::CFrame* cframe = this->path != NULL ? this->path->evaluate(time) : NULL;
+		*camera = base;
+		if (cframe != NULL) {
+			camera->setCFrame(cframe);
+			delete(cframe);
+		}
+	};
+
+	bool SequenceRenderer::render(int frameCount, int width, int height, const std::string& pattern) {
+		this->stats = { 0, 0.0, 0.0, 0.0, 0.0 };
+		if (frameCount <= 0) {
+			return true;
+		}
+		if (!isFramePattern(pattern)) {
+			std::cerr << "output pattern " << pattern << " needs exactly one %d (or %04d) for the frame number and no other %" << std::endl;
+			return false;
+		}
+		jobs::JobSystem* pool = this->renderer->pool;
+		auto start = std::chrono::steady_clock::now();
+
+		std::vector<Vector3> frames[2];
+		frames[0].resize((size_t) width * height);
+		frames[1].resize((size_t) width * height);
+		RenderCamera cameras[2];
+
+		// the I/O thread takes frames in order as they are handed over
+		std::mutex lock;
+		std::condition_variable changed;
+		int handedOver = 0;
+		int written = 0;
+		bool failed = false;
+		std::thread io([&]() {
+			for (int frame = 0; frame < frameCount; frame++) {
+				{
+					std::unique_lock<std::mutex> guard(lock);
+					changed.wait(guard, [&]() { return handedOver > frame || failed; });
+					if (handedOver <= frame) {
+						return;
+					}
+				}
+				auto writeStart = std::chrono::steady_clock::now();
+				std::string* filename = string_format(pattern, frame);
+				bool ok = saveImage(*filename, frames[frame & 1].data(), width, height);
+				if (!ok) {
+					std::cerr << "could not write " << *filename << std::endl;
+				}
+				delete(filename);
+				double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - writeStart).count();
+
+				std::lock_guard<std::mutex> guard(lock);
+				this->stats.writeSeconds += seconds;
+				written = frame + 1;
+				failed = failed || !ok;
+				changed.notify_all();
+				if (failed) {
+					return;
+				}
+			}
+		});
+
+		Scene* scene = this->renderer->scene;
+		RenderCamera camera = this->renderer->camera;
+		auto setupStart = std::chrono::steady_clock::now();
+		this->setup(0, camera, &cameras[0]);
+		this->stats.setupSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - setupStart).count();
+		for (int frame = 0; frame < frameCount; frame++) {
+			jobs::Counter setupDone;
+			std::atomic<double> setupSeconds(0.0);
+			if (frame + 1 < frameCount) {
+				pool->run([this, frame, &camera, &cameras, &setupSeconds]() {
+					auto jobStart = std::chrono::steady_clock::now();
+					this->setup(frame + 1, camera, &cameras[(frame + 1) & 1]);
+					setupSeconds.store(std::chrono::duration<double>(std::chrono::steady_clock::now() - jobStart).count());
+				}, &setupDone);
+			}
+
+			// frame - 2 used this buffer, the writer has to be done with it
+			{
+				std::unique_lock<std::mutex> guard(lock);
+				changed.wait(guard, [&]() { return written >= frame - 1 || failed; });
+				if (failed) {
+					pool->wait(&setupDone);
+					break;
+				}
+			}
+
+			this->renderer->scene = this->scenes[frame & 1];
+			this->renderer->camera = cameras[frame & 1];
+			auto traceStart = std::chrono::steady_clock::now();
+			this->renderer->renderImage(frames[frame & 1].data(), width, height);
+			this->stats.traceSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - traceStart).count();
+
+			pool->wait(&setupDone);
+			this->stats.setupSeconds += setupSeconds.load();
+			this->stats.frames += 1;
+
+			std::lock_guard<std::mutex> guard(lock);
+			handedOver = frame + 1;
+			changed.notify_all();
+		}
+
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if (handedOver < frameCount) {
+				failed = true; // stops the I/O thread waiting for frames that will not come
+			}
+			changed.notify_all();
+		}
+		io.join();
+
+		this->renderer->scene = scene;
+		this->renderer->camera = camera;
+		this->stats.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		return !failed && written == frameCount;
+	};
+
+};
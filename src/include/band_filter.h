@@ -0,0 +1,187 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+#include "raylib.h"
+#include "accumulation.h"
+
+namespace tracer {
+
+	// Structs //
+	// Consecutive rows of a larger image, start being the image row of the first one.
+	// Rows outside the image are clamped to its edge, so filters need no border cases.
+	struct RowBand {
+		const Vector3* pixels;
+		int width;
+		int start;
+		int rows;
+		int imageHeight;
+	};
+
+	inline const Vector3* bandRow(const RowBand& band, int y) {
+		y = std::max(0, std::min(band.imageHeight - 1, y));
+		return band.pixels + (size_t) (y - band.start) * band.width;
+	}
+
+	// Classes //
+	// A post pass over linear radiance that can run on bands instead of the whole image.
+	// Output row y reads input rows y - margin() to y + margin() and nothing further, so
+	// bands that hold that many rows on either side filter exactly like the full frame.
+	class BandFilter {
+		public:
+			BandFilter();
+			virtual ~BandFilter();
+
+			virtual int margin() = 0;
+			// rows y to y + count of the image into output, width pixels each
+			virtual void apply(const RowBand& input, int y, int count, Vector3* output) = 0;
+	};
+
+	// pulls isolated bright pixels down to ratio times their brightest neighbour
+	class FireflyFilter : public BandFilter {
+		public:
+			float ratio;
+
+			FireflyFilter();
+			~FireflyFilter();
+
+			int margin();
+			void apply(const RowBand& input, int y, int count, Vector3* output);
+	};
+
+	// separable gaussian blur, sigma of half the radius
+	class GaussianFilter : public BandFilter {
+		public:
+			GaussianFilter(int radius);
+			~GaussianFilter();
+
+			int margin();
+			void apply(const RowBand& input, int y, int count, Vector3* output);
+
+		private:
+			int radius;
+			std::vector<float> weights;   // radius + 1 taps, center first
+	};
+
+	// Methods //
+	// "firefly" or "gaussian", NULL for anything else
+	BandFilter* createBandFilter(const std::string& name);
+
+	// BandFilter //
+	BandFilter::BandFilter() {
+
+	};
+
+	BandFilter::~BandFilter() {
+
+	};
+
+	// FireflyFilter //
+	FireflyFilter::FireflyFilter() {
+		this->ratio = 4.0f;
+	};
+
+	FireflyFilter::~FireflyFilter() {
+
+	};
+
+	int FireflyFilter::margin() {
+		return 1;
+	};
+
+	void FireflyFilter::apply(const RowBand& input, int y, int count, Vector3* output) {
+		int width = input.width;
+		for (int r = 0; r < count; r++) {
+			const Vector3* rows[3] = { bandRow(input, y + r - 1), bandRow(input, y + r), bandRow(input, y + r + 1) };
+			Vector3* target = output + (size_t) r * width;
+			for (int x = 0; x < width; x++) {
+				float brightest = 0.0f;
+				for (int j = 0; j < 3; j++) {
+					for (int i = -1; i <= 1; i++) {
+						int sx = std::max(0, std::min(width - 1, x + i));
+						if (rows[j] == rows[1] && sx == x) {
+							continue; // the pixel itself, also where the edge clamps onto it
+						}
+						brightest = std::max(brightest, luminance(rows[j][sx]));
+					}
+				}
+				Vector3 pixel = rows[1][x];
+				float l = luminance(pixel);
+				float limit = this->ratio * brightest;
+				if (l > limit && l > 0.0f) {
+					float scale = limit / l;
+					pixel = { pixel.x * scale, pixel.y * scale, pixel.z * scale };
+				}
+				target[x] = pixel;
+			}
+		}
+	};
+
+	// GaussianFilter //
+	GaussianFilter::GaussianFilter(int radius) {
+		this->radius = std::max(1, radius);
+		float sigma = 0.5f * this->radius;
+		float sum = 0.0f;
+		this->weights.resize(this->radius + 1);
+		for (int i = 0; i <= this->radius; i++) {
+			this->weights[i] = std::exp(-(float) (i * i) / (2.0f * sigma * sigma));
+			sum += i == 0 ? this->weights[i] : 2.0f * this->weights[i];
+		}
+		for (float& weight : this->weights) {
+			weight /= sum;
+		}
+	};
+
+	GaussianFilter::~GaussianFilter() {
+
+	};
+
+	int GaussianFilter::margin() {
+		return this->radius;
+	};
+
+	void GaussianFilter::apply(const RowBand& input, int y, int count, Vector3* output) {
+		int width = input.width;
+		std::vector<Vector3> column((size_t) width);
+		for (int r = 0; r < count; r++) {
+			// vertical into one row, then horizontal from it into the output
+			for (int x = 0; x < width; x++) {
+				column[x] = { 0.0f, 0.0f, 0.0f };
+			}
+			for (int k = -this->radius; k <= this->radius; k++) {
+				const Vector3* source = bandRow(input, y + r + k);
+				float weight = this->weights[std::abs(k)];
+				for (int x = 0; x < width; x++) {
+					column[x].x += source[x].x * weight;
+					column[x].y += source[x].y * weight;
+					column[x].z += source[x].z * weight;
+				}
+			}
+			Vector3* target = output + (size_t) r * width;
+			for (int x = 0; x < width; x++) {
+				Vector3 sum = { 0.0f, 0.0f, 0.0f };
+				for (int k = -this->radius; k <= this->radius; k++) {
+					const Vector3& tap = column[std::max(0, std::min(width - 1, x + k))];
+					float weight = this->weights[std::abs(k)];
+					sum.x += tap.x * weight;
+					sum.y += tap.y * weight;
+					sum.z += tap.z * weight;
+				}
+				target[x] = sum;
+			}
+		}
+	};
+
+	BandFilter* createBandFilter(const std::string& name) {
+		if (name == "firefly") {
+			return new FireflyFilter();
+		}
+		if (name == "gaussian") {
+			return new GaussianFilter(2);
+		}
+		return NULL;
+	}
+
+};
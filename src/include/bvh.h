@@ -0,0 +1,302 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include "raylib.h"
+#include "geometry.h"
+#include "jobs.h"
+
+namespace geometry {
+
+	// Structs //
+	// interior nodes store their left child index in leftFirst (right child is leftFirst + 1),
+	// leaves store the first entry of BVH::indices and a non zero count
+	struct BVHNode {
+		BoundingBox box;
+		int leftFirst;
+		int count;
+	};
+
+	// Classes //
+	// binned SAH bounding volume hierarchy over a list of boxes, used both for
+	// per object hierarchies (triangles, primitives) and the scene level one
+	class BVH {
+		public:
+			static const int BIN_COUNT = 12;
+			static const int MAX_LEAF_SIZE = 4;
+			static const int STACK_SIZE = 64;
+			static const int PARALLEL_THRESHOLD = 4096;   // subtrees at least this large are built as their own job
+
+			std::vector<BVHNode> nodes;
+			std::vector<int> indices;
+
+			BVH();
+			~BVH();
+
+			void toDefault();
+			void build(const std::vector<BoundingBox>& boxes);
+			void refit(const std::vector<BoundingBox>& boxes);
+			BoundingBox bounds();
+			bool empty();
+			size_t memoryUsage();
+
+			// leaf(int index, float& tMax) tests one entry and shrinks tMax on a closer hit,
+			// returning true when it hit. anyHit stops at the first reported hit.
+			template<typename LeafFn>
+			bool traverse(const Ray& ray, float tMax, bool anyHit, LeafFn leaf);
+
+		private:
+			void updateBounds(int nodeIndex, const std::vector<BoundingBox>& boxes);
+			void subdivide(int nodeIndex, const std::vector<BoundingBox>& boxes, const std::vector<Vector3>& centers, int depth, std::atomic<int>* nodesUsed, jobs::Counter* pending);
+	};
+
+	BVH::BVH() {
+		this->toDefault();
+	};
+
+	BVH::~BVH() {
+
+	};
+
+	void BVH::toDefault() {
+		this->nodes.clear();
+		this->indices.clear();
+	};
+
+	void BVH::build(const std::vector<BoundingBox>& boxes) {
+		this->toDefault();
+		if (boxes.empty()) {
+			return;
+		}
+
+		std::vector<Vector3> centers(boxes.size());
+		this->indices.resize(boxes.size());
+		for (size_t i = 0; i < boxes.size(); i++) {
+			centers[i] = centroid(boxes[i]);
+			this->indices[i] = (int) i;
+		}
+
+		// sized up front (a binary tree over n leaves has at most 2n - 1 nodes) so subtrees
+		// can be built on other workers while node slots are handed out atomically
+		this->nodes.resize(boxes.size() * 2);
+		this->nodes[0].leftFirst = 0;
+		this->nodes[0].count = (int) boxes.size();
+		this->updateBounds(0, boxes);
+
+		std::atomic<int> nodesUsed(1);
+		jobs::Counter pending;
+		this->subdivide(0, boxes, centers, 0, &nodesUsed, &pending);
+		jobs::shared()->wait(&pending);
+
+		this->nodes.resize(nodesUsed.load());
+		this->nodes.shrink_to_fit();
+	};
+
+	void BVH::refit(const std::vector<BoundingBox>& boxes) {
+		// children are always stored after their parent, so a reverse sweep is bottom up
+		for (int i = (int) this->nodes.size() - 1; i >= 0; i--) {
+			BVHNode* node = &this->nodes[i];
+			if (node->count > 0) {
+				this->updateBounds(i, boxes);
+			} else {
+				node->box = merge(this->nodes[node->leftFirst].box, this->nodes[node->leftFirst + 1].box);
+			}
+		}
+	};
+
+	BoundingBox BVH::bounds() {
+		return this->nodes.empty() ? emptyBounds() : this->nodes[0].box;
+	};
+
+	bool BVH::empty() {
+		return this->nodes.empty();
+	};
+
+	size_t BVH::memoryUsage() {
+		return this->nodes.size() * sizeof(BVHNode) + this->indices.size() * sizeof(int);
+	};
+
+	void BVH::updateBounds(int nodeIndex, const std::vector<BoundingBox>& boxes) {
+		BVHNode* node = &this->nodes[nodeIndex];
+		node->box = emptyBounds();
+		for (int i = 0; i < node->count; i++) {
+			node->box = merge(node->box, boxes[this->indices[node->leftFirst + i]]);
+		}
+	};
+
+	void BVH::subdivide(int nodeIndex, const std::vector<BoundingBox>& boxes, const std::vector<Vector3>& centers, int depth, std::atomic<int>* nodesUsed, jobs::Counter* pending) {
+		BVHNode node = this->nodes[nodeIndex];
+		if (node.count <= MAX_LEAF_SIZE || depth >= STACK_SIZE - 2) {
+			return;
+		}
+
+		// centroid bounds decide the binning range
+		BoundingBox centerBox = emptyBounds();
+		for (int i = 0; i < node.count; i++) {
+			grow(&centerBox, centers[this->indices[node.leftFirst + i]]);
+		}
+
+		int bestAxis = -1;
+		int bestSplit = 0;
+		float bestCost = surfaceArea(node.box) * (float) node.count;
+
+		for (int axis = 0; axis < 3; axis++) {
+			float lo = component(centerBox.min, axis);
+			float hi = component(centerBox.max, axis);
+			if (hi <= lo) {
+				continue;
+			}
+
+			BoundingBox binBoxes[BIN_COUNT];
+			int binCounts[BIN_COUNT] = { 0 };
+			for (int b = 0; b < BIN_COUNT; b++) {
+				binBoxes[b] = emptyBounds();
+			}
+
+			float binScale = (float) BIN_COUNT / (hi - lo);
+			for (int i = 0; i < node.count; i++) {
+				int index = this->indices[node.leftFirst + i];
+				int b = std::min(BIN_COUNT - 1, (int) ((component(centers[index], axis) - lo) * binScale));
+				binCounts[b] += 1;
+				binBoxes[b] = merge(binBoxes[b], boxes[index]);
+			}
+
+			// sweep from both sides to get the cost of every plane between bins
+			float leftArea[BIN_COUNT - 1], rightArea[BIN_COUNT - 1];
+			int leftCount[BIN_COUNT - 1], rightCount[BIN_COUNT - 1];
+			BoundingBox leftBox = emptyBounds(), rightBox = emptyBounds();
+			int leftSum = 0, rightSum = 0;
+			for (int b = 0; b < BIN_COUNT - 1; b++) {
+				leftSum += binCounts[b];
+				leftBox = merge(leftBox, binBoxes[b]);
+				leftCount[b] = leftSum;
+				leftArea[b] = surfaceArea(leftBox);
+
+				rightSum += binCounts[BIN_COUNT - 1 - b];
+				rightBox = merge(rightBox, binBoxes[BIN_COUNT - 1 - b]);
+				rightCount[BIN_COUNT - 2 - b] = rightSum;
+				rightArea[BIN_COUNT - 2 - b] = surfaceArea(rightBox);
+			}
+
+			for (int b = 0; b < BIN_COUNT - 1; b++) {
+				if (leftCount[b] == 0 || rightCount[b] == 0) {
+					continue;
+				}
+				float cost = leftArea[b] * (float) leftCount[b] + rightArea[b] * (float) rightCount[b];
+				if (cost < bestCost) {
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = b;
+				}
+			}
+		}
+
+		if (bestAxis == -1) {
+			return; // splitting is not cheaper than this leaf
+		}
+
+		float lo = component(centerBox.min, bestAxis);
+		float binScale = (float) BIN_COUNT / (component(centerBox.max, bestAxis) - lo);
+
+		int i = node.leftFirst;
+		int j = node.leftFirst + node.count - 1;
+		while (i <= j) {
+			int b = std::min(BIN_COUNT - 1, (int) ((component(centers[this->indices[i]], bestAxis) - lo) * binScale));
+			if (b <= bestSplit) {
+				i++;
+			} else {
+				std::swap(this->indices[i], this->indices[j]);
+				j--;
+			}
+		}
+
+		int leftCountTotal = i - node.leftFirst;
+		if (leftCountTotal == 0 || leftCountTotal == node.count) {
+			return;
+		}
+
+		int leftIndex = nodesUsed->fetch_add(2, std::memory_order_relaxed);
+		this->nodes[leftIndex].leftFirst = node.leftFirst;
+		this->nodes[leftIndex].count = leftCountTotal;
+		this->nodes[leftIndex + 1].leftFirst = i;
+		this->nodes[leftIndex + 1].count = node.count - leftCountTotal;
+
+		this->nodes[nodeIndex].leftFirst = leftIndex;
+		this->nodes[nodeIndex].count = 0;
+
+		this->updateBounds(leftIndex, boxes);
+		this->updateBounds(leftIndex + 1, boxes);
+
+		// the two halves touch disjoint ranges of indices and nodes, so a large left half
+		// goes to the job system while this thread carries on with the right one
+		if (leftCountTotal >= PARALLEL_THRESHOLD) {
+			jobs::shared()->run([this, leftIndex, &boxes, &centers, depth, nodesUsed, pending]() {
+				this->subdivide(leftIndex, boxes, centers, depth + 1, nodesUsed, pending);
+			}, pending);
+		} else {
+			this->subdivide(leftIndex, boxes, centers, depth + 1, nodesUsed, pending);
+		}
+		this->subdivide(leftIndex + 1, boxes, centers, depth + 1, nodesUsed, pending);
+	};
+
+	template<typename LeafFn>
+	bool BVH::traverse(const Ray& ray, float tMax, bool anyHit, LeafFn leaf) {
+		if (this->nodes.empty()) {
+			return false;
+		}
+
+		Vector3 invDir = inverseDirection(ray.direction);
+		float tNear;
+		if (!intersectBounds(ray, invDir, this->nodes[0].box, tMax, &tNear)) {
+			return false;
+		}
+
+		int stack[STACK_SIZE];
+		float stackNear[STACK_SIZE];
+		int stackSize = 0;
+		stack[stackSize] = 0;
+		stackNear[stackSize++] = tNear;
+
+		bool found = false;
+		while (stackSize > 0) {
+			stackSize--;
+			if (stackNear[stackSize] >= tMax) {
+				continue; // a closer hit was found since this node was pushed
+			}
+			const BVHNode& node = this->nodes[stack[stackSize]];
+
+			if (node.count > 0) {
+				for (int i = 0; i < node.count; i++) {
+					if (leaf(this->indices[node.leftFirst + i], tMax)) {
+						found = true;
+						if (anyHit) {
+							return true;
+						}
+					}
+				}
+				continue;
+			}
+
+			// visit the nearer child first by pushing it last
+			float tLeft, tRight;
+			bool hitLeft = intersectBounds(ray, invDir, this->nodes[node.leftFirst].box, tMax, &tLeft);
+			bool hitRight = intersectBounds(ray, invDir, this->nodes[node.leftFirst + 1].box, tMax, &tRight);
+			if (hitLeft && hitRight) {
+				bool leftFirst = tLeft <= tRight;
+				stack[stackSize] = leftFirst ? node.leftFirst + 1 : node.leftFirst;
+				stackNear[stackSize++] = leftFirst ? tRight : tLeft;
+				stack[stackSize] = leftFirst ? node.leftFirst : node.leftFirst + 1;
+				stackNear[stackSize++] = leftFirst ? tLeft : tRight;
+			} else if (hitLeft) {
+				stack[stackSize] = node.leftFirst;
+				stackNear[stackSize++] = tLeft;
+			} else if (hitRight) {
+				stack[stackSize] = node.leftFirst + 1;
+				stackNear[stackSize++] = tRight;
+			}
+		}
+
+		return found;
+	};
+
+};
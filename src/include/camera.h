@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cmath>
+#include "raylib.h"
+#include "mathlib.h"
+#include "geometry.h"
+
+namespace tracer {
+
+	// Classes //
+	// Value copy of a CFrame's basis so ray generation never touches the heap.
+	// Looks down -Z of the CFrame like LookVector does.
+	class RenderCamera {
+		public:
+			Vector3 position;
+			Vector3 right;
+			Vector3 up;
+			Vector3 forward;
+			float fieldOfView;   // vertical, degrees
+
+			RenderCamera();
+			RenderCamera(mathlib::CFrame* cframe, float fieldOfView);
+			~RenderCamera();
+
+			void toDefault();
+			void setCFrame(mathlib::CFrame* cframe);
+			bool equals(const RenderCamera& other);
+			// raylib camera looking the same way, for picking and the window's camera controls
+			Camera toCamera();
+			// back from a raylib perspective camera, up is made square to the view direction
+			void setCamera(Camera camera);
+
+			// px, py are continuous pixel coordinates, (0.5, 0.5) is the center of the top left pixel
+			Ray generateRay(float px, float py, int width, int height);
+			// inverse of generateRay, false for points behind the camera
+			bool project(Vector3 point, int width, int height, float* px, float* py);
+	};
+
+	RenderCamera::RenderCamera() {
+		this->toDefault();
+	};
+
+	RenderCamera::RenderCamera(mathlib::CFrame* cframe, float fieldOfView) {
+		this->toDefault();
+		this->setCFrame(cframe);
+		this->fieldOfView = fieldOfView;
+	};
+
+	RenderCamera::~RenderCamera() {
+
+	};
+
+	void RenderCamera::toDefault() {
+		this->position = { 0, 0, 0 };
+		this->right = { 1, 0, 0 };
+		this->up = { 0, 1, 0 };
+		this->forward = { 0, 0, -1 };
+		this->fieldOfView = 70.0f;
+	};
+
+	void RenderCamera::setCFrame(mathlib::CFrame* cframe) {
+		mathlib::CFrameComponents c = cframe->components();
+		this->position = { c.x, c.y, c.z };
+		this->right = geometry::normalize({ c.m11, c.m21, c.m31 });
+		this->up = geometry::normalize({ c.m12, c.m22, c.m32 });
+		this->forward = geometry::normalize({ -c.m13, -c.m23, -c.m33 });
+	};
+
+	bool RenderCamera::equals(const RenderCamera& other) {
+		return this->position.x == other.position.x && this->position.y == other.position.y && this->position.z == other.position.z
+			&& this->right.x == other.right.x && this->right.y == other.right.y && this->right.z == other.right.z
+			&& this->up.x == other.up.x && this->up.y == other.up.y && this->up.z == other.up.z
+			&& this->forward.x == other.forward.x && this->forward.y == other.forward.y && this->forward.z == other.forward.z
+			&& this->fieldOfView == other.fieldOfView;
+	};
+
+	Camera RenderCamera::toCamera() {
+		Camera camera = { 0 };
+		camera.position = this->position;
+		camera.target = geometry::add(this->position, this->forward);
+		camera.up = this->up;
+		camera.fovy = this->fieldOfView;
+		camera.projection = CAMERA_PERSPECTIVE;
+		return camera;
+	};
+
+	void RenderCamera::setCamera(Camera camera) {
+		this->position = camera.position;
+		this->forward = geometry::normalize(geometry::sub(camera.target, camera.position));
+		this->right = geometry::normalize(geometry::cross(this->forward, camera.up));
+		this->up = geometry::cross(this->right, this->forward);
+		this->fieldOfView = camera.fovy;
+	};
+
+	Ray RenderCamera::generateRay(float px, float py, int width, int height) {
+		float tanHalf = std::tan(this->fieldOfView * 0.5f * DEG2RAD);
+		float aspect = (float) width / (float) height;
+		float sx = (2.0f * px / (float) width - 1.0f) * tanHalf * aspect;
+		float sy = (1.0f - 2.0f * py / (float) height) * tanHalf;
+
+		Ray ray;
+		ray.position = this->position;
+		ray.direction = geometry::normalize(geometry::add(this->forward, geometry::add(geometry::mul(this->right, sx), geometry::mul(this->up, sy))));
+		return ray;
+	};
+
+	bool RenderCamera::project(Vector3 point, int width, int height, float* px, float* py) {
+		Vector3 d = geometry::sub(point, this->position);
+		float z = geometry::dot(d, this->forward);
+		if (z <= 1e-6f) {
+			return false;
+		}
+		float tanHalf = std::tan(this->fieldOfView * 0.5f * DEG2RAD);
+		float aspect = (float) width / (float) height;
+		float sx = geometry::dot(d, this->right) / z;
+		float sy = geometry::dot(d, this->up) / z;
+		*px = (sx / (tanHalf * aspect) + 1.0f) * 0.5f * (float) width;
+		*py = (1.0f - sy / tanHalf) * 0.5f * (float) height;
+		return true;
+	};
+
+};
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include "raylib.h"
+#include "accumulation.h"
+#include "mapped_file.h"
+
+namespace tracer {
+
+	// Structs //
+	struct CheckpointHeader {
+		char magic[8];                        // "TRCKPT1\0"
+		int width;
+		int height;
+		int tileCount;
+		int tileStateSize;
+		unsigned long long key;               // hash of everything the samples depend on
+		unsigned long long generation[2];     // per slot, 0 while the slot is being written
+		int passes[2];
+		long long totalSamples[2];
+	};
+
+	// Classes //
+	// Progressive render state in a memory mapped file: the accumulation buffer (sums,
+	// squares, surfaces, and through the per pixel counts also where each pixel's sample
+	// sequence stands) and the per tile scheduler state.
+	//
+	// The file has two slots written in turn. A slot's generation is cleared and flushed
+	// before it is overwritten and only set again after its data is on disk, so a render
+	// killed at any point still has the previous slot to resume from.
+	//
+	// The live accumulation stays in ordinary memory and is copied into a slot after a whole
+	// pass, rather than being accumulated in the mapping itself. Tiles are written mid pass
+	// and the OS may page out a mapping at any moment, so a mapped live buffer could hit the
+	// disk half updated; one memcpy per save is cheap next to the pass it records.
+	class Checkpoint {
+		public:
+			std::string path;
+
+			Checkpoint();
+			~Checkpoint();
+
+			// maps the file for a render of this shape, keeping what is there when the key
+			// matches and starting it over otherwise. False on an I/O error.
+			bool open(const std::string& path, int width, int height, int tileCount, int tileStateSize, unsigned long long key);
+			// a finished slot from a render with the same key exists
+			bool resumable();
+			int passes();
+			bool save(const AccumulationBuffer& accumulation, const void* tiles, long long totalSamples);
+			// accumulation has to be reset to the checkpoint's size
+			bool load(AccumulationBuffer* accumulation, void* tiles, long long* totalSamples);
+			// once the render is done the checkpoint has nothing left to protect
+			bool remove();
+
+		private:
+			MappedFile file;
+			size_t slotSize;
+
+			CheckpointHeader* header();
+			unsigned char* slot(int index);
+			int latest();
+	};
+
+	// Methods //
+	// FNV-1a, chained through seed
+	inline unsigned long long hashBytes(const void* data, size_t size, unsigned long long seed) {
+		const unsigned char* bytes = (const unsigned char*) data;
+		unsigned long long h = seed != 0 ? seed : 0xcbf29ce484222325ull;
+		for (size_t i = 0; i < size; i++) {
+			h ^= bytes[i];
+			h *= 0x100000001b3ull;
+		}
+		return h;
+	}
+
+	// Checkpoint //
+	Checkpoint::Checkpoint() {
+		this->slotSize = 0;
+	};
+
+	Checkpoint::~Checkpoint() {
+
+	};
+
+	CheckpointHeader* Checkpoint::header() {
+		return (CheckpointHeader*) this->file.data();
+	};
+
+	// slots start on their own pages so flushing one never rewrites the other
+	unsigned char* Checkpoint::slot(int index) {
+		return this->file.data() + 4096 + (size_t) index * this->slotSize;
+	};
+
+	int Checkpoint::latest() {
+		CheckpointHeader* h = this->header();
+		if (h->generation[0] == 0 && h->generation[1] == 0) {
+			return -1;
+		}
+		return h->generation[1] > h->generation[0] ? 1 : 0;
+	};
+
+	bool Checkpoint::open(const std::string& path, int width, int height, int tileCount, int tileStateSize, unsigned long long key) {
+		this->path = path;
+		size_t pixels = (size_t) width * height;
+		size_t data = pixels * (sizeof(Vector4) + 2 * sizeof(float) + sizeof(Vector3)) + (size_t) tileCount * tileStateSize;
+		this->slotSize = (data + 4095) / 4096 * 4096;
+
+		bool existing = false;
+		if (!this->file.open(path, 4096 + 2 * this->slotSize, &existing)) {
+			return false;
+		}
+		CheckpointHeader* h = this->header();
+		bool matches = existing && std::memcmp(h->magic, "TRCKPT1", 8) == 0 && h->width == width && h->height == height
+			&& h->tileCount == tileCount && h->tileStateSize == tileStateSize && h->key == key;
+		if (matches) {
+			return true;
+		}
+		if (existing) {
+			std::cerr << "checkpoint " << path << " is from a different render, starting over" << std::endl;
+		}
+		std::memset(h, 0, sizeof(CheckpointHeader));
+		std::memcpy(h->magic, "TRCKPT1", 8);
+		h->width = width;
+		h->height = height;
+		h->tileCount = tileCount;
+		h->tileStateSize = tileStateSize;
+		h->key = key;
+		return this->file.flush(0, sizeof(CheckpointHeader));
+	};
+
+	bool Checkpoint::resumable() {
+		return this->file.isOpen() && this->latest() >= 0;
+	};
+
+	int Checkpoint::passes() {
+		int index = this->resumable() ? this->latest() : -1;
+		return index >= 0 ? this->header()->passes[index] : 0;
+	};
+
+	bool Checkpoint::save(const AccumulationBuffer& accumulation, const void* tiles, long long totalSamples) {
+		if (!this->file.isOpen()) {
+			return false;
+		}
+		CheckpointHeader* h = this->header();
+		int index = this->latest() == 0 ? 1 : 0;
+		unsigned long long next = std::max(h->generation[0], h->generation[1]) + 1;
+		h->generation[index] = 0;
+		if (!this->file.flush(0, sizeof(CheckpointHeader))) {
+			return false;
+		}
+
+		size_t pixels = (size_t) h->width * h->height;
+		unsigned char* target = this->slot(index);
+		std::memcpy(target, accumulation.pixels.data(), pixels * sizeof(Vector4));
+		target += pixels * sizeof(Vector4);
+		std::memcpy(target, accumulation.squares.data(), pixels * sizeof(float));
+		target += pixels * sizeof(float);
+		std::memcpy(target, accumulation.depth.data(), pixels * sizeof(float));
+		target += pixels * sizeof(float);
+		std::memcpy(target, accumulation.normals.data(), pixels * sizeof(Vector3));
+		target += pixels * sizeof(Vector3);
+		std::memcpy(target, tiles, (size_t) h->tileCount * h->tileStateSize);
+		h->passes[index] = accumulation.passes;
+		h->totalSamples[index] = totalSamples;
+		if (!this->file.flush((size_t) (this->slot(index) - this->file.data()), this->slotSize)) {
+			return false;
+		}
+
+		h->generation[index] = next;
+		return this->file.flush(0, sizeof(CheckpointHeader));
+	};
+
+	bool Checkpoint::load(AccumulationBuffer* accumulation, void* tiles, long long* totalSamples) {
+		int index = this->resumable() ? this->latest() : -1;
+		if (index < 0) {
+			return false;
+		}
+		CheckpointHeader* h = this->header();
+		size_t pixels = (size_t) h->width * h->height;
+		const unsigned char* source = this->slot(index);
+		std::memcpy(accumulation->pixels.data(), source, pixels * sizeof(Vector4));
+		source += pixels * sizeof(Vector4);
+		std::memcpy(accumulation->squares.data(), source, pixels * sizeof(float));
+		source += pixels * sizeof(float);
+		std::memcpy(accumulation->depth.data(), source, pixels * sizeof(float));
+		source += pixels * sizeof(float);
+		std::memcpy(accumulation->normals.data(), source, pixels * sizeof(Vector3));
+		source += pixels * sizeof(Vector3);
+		std::memcpy(tiles, source, (size_t) h->tileCount * h->tileStateSize);
+		accumulation->passes = h->passes[index];
+		*totalSamples = h->totalSamples[index];
+		return true;
+	};
+
+	bool Checkpoint::remove() {
+		this->file.close();
+		return std::remove(this->path.c_str()) == 0;
+	};
+
+};
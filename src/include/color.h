@@ -1,38 +1,102 @@
 #pragma once
 
-#include <ios>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
 #include "stringlib.h"
 
 namespace Color3 {
 
+	// Structs //
+	struct Hsv {
+		float H;   // degrees, [0, 360)
+		float S;   // [0, 1]
+		float V;   // [0, 1]
+	};
+
+	// Classes //
+	// Plain value: three floats, copied and returned by value, so shading and post passes
+	// can do arithmetic on colors without touching the heap. Arrays of them are tightly
+	// packed, which the span conversions below rely on.
 	class Color3 {
 		public:
 			float R, G, B;
 			Color3();
 			Color3(int r, int g, int b);
 			Color3(float r, float g, float b);
-			~Color3();
 
 			void setDefault();
 
-			float getR();
-			float getG();
-			float getB();
+			float getR() const;
+			float getG() const;
+			float getB() const;
 
-			Color3* copy();
+			Color3 copy() const;
 			std::string* toString();
 
-			static Color3* getShade(Color3* color, float shade);
-			static Color3* mixAll(Color3* colors[]);
-			static Color3* mix(Color3* color);
-
-			static Color3* fromRGB(int R, int G, int B);
-			static Color3* fromHSV(int H, int S, int V);
-			static Color3* fromHex(int hex_value);
+			Color3 operator+(const Color3& other) const;
+			Color3 operator-(const Color3& other) const;
+			Color3 operator*(const Color3& other) const;
+			Color3 operator*(float v) const;
+			Color3 operator/(float v) const;
+			Color3& operator+=(const Color3& other);
+			Color3& operator-=(const Color3& other);
+			Color3& operator*=(const Color3& other);
+			Color3& operator*=(float v);
+			bool operator==(const Color3& other) const;
+			bool operator!=(const Color3& other) const;
 	};
 
+	static_assert(std::is_trivially_copyable<Color3>::value && sizeof(Color3) == 12, "Color3 spans are read as packed floats");
+	static_assert(std::is_trivially_copyable<Hsv>::value && sizeof(Hsv) == 12, "Hsv spans are read as packed floats");
+
+	// Methods //
+	Color3 operator*(float v, const Color3& color);
+
+	Color3 getShade(Color3 color, float shade);
+	Color3 mixAll(const Color3* colors, size_t count);
+	Color3 mix(Color3 a, Color3 b);
+
+	Color3 fromRGB(int R, int G, int B);
+	Color3 fromHSV(float h, float s, float v);
+	Color3 fromHex(int hex_value);
+	inline Hsv toHSV(Color3 color);
+	int toHex(Color3 color);
+
+	float srgbToLinear(float v);
+	float linearToSrgb(float v);
+	// log2 and exp2 from the float's exponent bits and short polynomials, within about
+	// 1e-6 relative. No calls and no branches, so loops over them vectorize.
+	inline float fastLog2(float x);   // x positive and normal
+	inline float fastExp2(float x);   // x clamped to [-126, 127]
+
+	// Span conversions: count colors from in to out, no allocation, in and out may be the
+	// same array. They work through blocks of SPAN_BLOCK colors copied to local arrays:
+	// GCC's -O2 cost model vectorizes those fixed length loops, while a loop over the
+	// caller's arrays of unknown length would stay scalar. The sRGB curves go through
+	// fastLog2 and fastExp2 instead of std::pow and agree with srgbToLinear and
+	// linearToSrgb to about 1e-6.
+	static const int SPAN_BLOCK = 8;
+	void toLinear(const Color3* in, Color3* out, size_t count);
+	void toSRGB(const Color3* in, Color3* out, size_t count);
+	void toHSV(const Color3* in, Hsv* out, size_t count);
+	void fromHSV(const Hsv* in, Color3* out, size_t count);
+	void toHex(const Color3* in, int* out, size_t count);
+	void fromHex(const int* in, Color3* out, size_t count);
+	// 4 bytes per color in R, G, B, A order with A at 255, as in an R8G8B8A8 image.
+	// The colors are clamped to [0, 1] and taken as already display encoded.
+	void toRGBA8(const Color3* in, unsigned char* out, size_t count);
+	void fromRGBA8(const unsigned char* in, Color3* out, size_t count);
+	// sRGB encoded 8 bit to linear float, for textures
+	void fromRGBA8Linear(const unsigned char* in, Color3* out, size_t count);
+
+	// Color3 //
 	Color3::Color3() {
-
+		this->setDefault();
 	};
 
 	Color3::Color3(int r, int g, int b) {
@@ -47,37 +111,85 @@ namespace Color3 {
 		this->B = b;
 	};
 
-	Color3::~Color3() {
-
-	};
-
 	void Color3::setDefault() {
 		this->R = 0;
 		this->G = 0;
 		this->B = 0;
 	}
 
-	float Color3::getR() {
+	float Color3::getR() const {
 		return this->R;
 	};
 
-	float Color3::getG() {
+	float Color3::getG() const {
 		return this->G;
 	};
 
-	float Color3::getB() {
+	float Color3::getB() const {
 		return this->B;
 	};
 
-	Color3* Color3::copy() {
-		return new Color3(this->R, this->G, this->B);
+	Color3 Color3::copy() const {
+		return *this;
 	};
 
 	std::string* Color3::toString() {
 		return string_format("Color3(%f, %f, %f)", this->R, this->G, this->B);
 	}
 
-	Color3* getShade(Color3 color, float shade) {
+	Color3 Color3::operator+(const Color3& other) const {
+		return Color3(this->R + other.R, this->G + other.G, this->B + other.B);
+	};
+
+	Color3 Color3::operator-(const Color3& other) const {
+		return Color3(this->R - other.R, this->G - other.G, this->B - other.B);
+	};
+
+	Color3 Color3::operator*(const Color3& other) const {
+		return Color3(this->R * other.R, this->G * other.G, this->B * other.B);
+	};
+
+	Color3 Color3::operator*(float v) const {
+		return Color3(this->R * v, this->G * v, this->B * v);
+	};
+
+	Color3 Color3::operator/(float v) const {
+		return *this * (1.0f / v);
+	};
+
+	Color3& Color3::operator+=(const Color3& other) {
+		*this = *this + other;
+		return *this;
+	};
+
+	Color3& Color3::operator-=(const Color3& other) {
+		*this = *this - other;
+		return *this;
+	};
+
+	Color3& Color3::operator*=(const Color3& other) {
+		*this = *this * other;
+		return *this;
+	};
+
+	Color3& Color3::operator*=(float v) {
+		*this = *this * v;
+		return *this;
+	};
+
+	bool Color3::operator==(const Color3& other) const {
+		return this->R == other.R && this->G == other.G && this->B == other.B;
+	};
+
+	bool Color3::operator!=(const Color3& other) const {
+		return !(*this == other);
+	};
+
+	Color3 operator*(float v, const Color3& color) {
+		return color * v;
+	};
+
+	Color3 getShade(Color3 color, float shade) {
 		double redLinear = pow(color.getR(), 2.4) * shade;
 		double greenLinear = pow(color.getG(), 2.4) * shade;
 		double blueLinear = pow(color.getB(), 2.4) * shade;
@@ -86,111 +198,306 @@ namespace Color3 {
 		float green = pow(greenLinear, 1/2.4);
 		float blue = pow(blueLinear, 1/2.4);
 
-		return new Color3(red, green, blue);
+		return Color3(red, green, blue);
 	};
 
-	Color3* mixAll(Color3* colors[]) {
-		if ( sizeof(colors) == 0){
-			return new Color3();
+	// the mean of count colors, black for none
+	Color3 mixAll(const Color3* colors, size_t count) {
+		if (count == 0) {
+			return Color3();
 		};
 
-		float concentration = (float) (1.0 / (1.0 + sizeof(colors)));
-
-		float A_r = 1 * concentration;
-		float A_g = 1 * concentration;
-		float A_b = 1 * concentration;
-
-		for (unsigned int i = 0; i < sizeof(colors); i += 1 ) {
-			A_r += colors[i]->getR() * concentration;
-			A_g += colors[i]->getG() * concentration;
-			A_b += colors[i]->getB() * concentration;
+		Color3 sum;
+		for (size_t i = 0; i < count; i += 1) {
+			sum += colors[i];
 		};
 
-		return new Color3(A_r, A_g, A_b);
+		return sum / (float) count;
 	};
 
-	Color3* mix(Color3* a, Color3* b) {
-		return new Color3(
-			(a->getR() + b->getR()) / 2,
-			(a->getG() + b->getG()) / 2,
-			(a->getB() + b->getB()) / 2
-		);
+	Color3 mix(Color3 a, Color3 b) {
+		return (a + b) * 0.5f;
 	};
 
-	Color3* fromRGB(int R, int G, int B) {
-		return new Color3(
+	Color3 fromRGB(int R, int G, int B) {
+		return Color3(
 			(float) R / 255.0f,
 			(float) G / 255.0f,
 			(float) B / 255.0f
 		);
 	};
 
-	Color3* fromHSV(int h, int s, int v) {
-		double hh, p, q, t, ff;
-		long i;
-		Color3* out = new Color3();
+	// a if condition holds, b otherwise, as a bit mask. GCC keeps float arithmetic feeding
+	// either side of a ?: behind a branch, since it may raise a floating point exception,
+	// and a branch keeps the loop around it scalar; the mask is a vector compare and and.
+	inline float blend(bool condition, float a, float b) {
+		uint32_t ia, ib;
+		std::memcpy(&ia, &a, sizeof(ia));
+		std::memcpy(&ib, &b, sizeof(ib));
+		uint32_t mask = 0u - (uint32_t) condition;
+		uint32_t bits = (ia & mask) | (ib & ~mask);
+		float result;
+		std::memcpy(&result, &bits, sizeof(result));
+		return result;
+	}
 
-		if(s <= 0.0) {
-			out->R = v;
-			out->G = v;
-			out->B = v;
-			return out;
-		};
+	// min and max as blends, std::min and std::max return references that end up as branches
+	inline float lesser(float a, float b) {
+		return blend(b < a, b, a);
+	}
 
-		hh = h;
-		if(hh >= 360.0)
-			hh = 0.0;
-		hh /= 60.0;
-
-		i = (long)hh;
-		ff = hh - i;
-		p = v * (1.0 - s);
-		q = v * (1.0 - (s * ff));
-		t = v * (1.0 - (s * (1.0 - ff)));
-
-		switch(i) {
-			case 0:
-				out->R = v;
-				out->G = t;
-				out->B = p;
-				break;
-			case 1:
-				out->R = q;
-				out->G = v;
-				out->B = p;
-				break;
-			case 2:
-				out->R = p;
-				out->G = v;
-				out->B = t;
-				break;
-			case 3:
-				out->R = p;
-				out->G = q;
-				out->B = v;
-				break;
-			case 4:
-				out->R = t;
-				out->G = p;
-				out->B = v;
-				break;
-			default:
-				out->R = v;
-				out->G = p;
-				out->B = q;
-				break;
-		}
+	inline float greater(float a, float b) {
+		return blend(a < b, b, a);
+	}
 
-		return out;
+	// branch free form of the sector switch: channel n is v - v s clamp(min(k, 4 - k))
+	// with k = (n + h / 60) mod 6, n being 5, 3 and 1 for red, green and blue. The mod is
+	// a truncating conversion and a blend rather than fmod, which is a call.
+	inline float hsvChannel(float offset, float hh, float s, float v) {
+		float k = offset + hh;
+		k -= 6.0f * (float) (int) (k * (1.0f / 6.0f));
+		k = blend(k < 0.0f, k + 6.0f, k);
+		return v - v * s * greater(0.0f, lesser(lesser(k, 4.0f - k), 1.0f));
+	}
+
+	Color3 fromHSV(float h, float s, float v) {
+		float hh = h / 60.0f;
+		return Color3(hsvChannel(5.0f, hh, s, v), hsvChannel(3.0f, hh, s, v), hsvChannel(1.0f, hh, s, v));
 	};
 
-	Color3* fromHex(int hex_value) {
-		return new Color3(
+	Color3 fromHex(int hex_value) {
+		return Color3(
 			((hex_value >> 16) & 0xFF), // Extract the RR byte
 			((hex_value >> 8) & 0xFF), // Extract the GG byte
 			((hex_value) & 0xFF) // Extract the BB byte
 		);
 	};
 
-}
+	inline Hsv toHSV(Color3 color) {
+		float high = greater(color.R, greater(color.G, color.B));
+		float low = lesser(color.R, lesser(color.G, color.B));
+		float delta = high - low;
+		float scale = blend(delta > 0.0f, 60.0f / delta, 0.0f);
+		float h = blend(high == color.R, (color.G - color.B) * scale,
+			blend(high == color.G, 120.0f + (color.B - color.R) * scale, 240.0f + (color.R - color.G) * scale));
+		h = blend(h < 0.0f, h + 360.0f, h);
+		return { h, blend(high > 0.0f, delta / high, 0.0f), high };
+	};
+
+	// clamped to [0, 1], + 0.5 and truncation rounds to the nearest of 0 .. 255
+	inline int toByte(float v) {
+		return (int) (lesser(greater(v, 0.0f), 1.0f) * 255.0f + 0.5f);
+	}
 
+	int toHex(Color3 color) {
+		return (toByte(color.R) << 16) | (toByte(color.G) << 8) | toByte(color.B);
+	};
+
+	// the exact piecewise sRGB transfer functions
+	float srgbToLinear(float v) {
+		return v <= 0.04045f ? v / 12.92f : std::pow((v + 0.055f) / 1.055f, 2.4f);
+	};
+
+	float linearToSrgb(float v) {
+		return v <= 0.0031308f ? v * 12.92f : 1.055f * std::pow(v, 1.0f / 2.4f) - 0.055f;
+	};
+
+	inline float fastLog2(float x) {
+		uint32_t bits;
+		std::memcpy(&bits, &x, sizeof(bits));
+		int exponent = (int) (bits >> 23) - 127;
+		bits = (bits & 0x007fffffu) | 0x3f800000u;
+		float m;
+		std::memcpy(&m, &bits, sizeof(m));
+		// mantissa moved from [1, 2) to [sqrt(1/2), sqrt(2)), where the series is shortest
+		bool high = m > 1.41421356f;
+		m = blend(high, m * 0.5f, m);
+		float e = (float) exponent + blend(high, 1.0f, 0.0f);
+		// log2(m) = 2 / ln 2 * atanh(t), t = (m - 1) / (m + 1), |t| < 0.172
+		float t = (m - 1.0f) / (m + 1.0f);
+		float t2 = t * t;
+		float series = t * (1.0f + t2 * (1.0f / 3.0f + t2 * (1.0f / 5.0f + t2 * (1.0f / 7.0f))));
+		return e + series * 2.88539008f;
+	}
+
+	inline float fastExp2(float x) {
+		x = blend(x < -126.0f, -126.0f, blend(x > 127.0f, 127.0f, x));
+		// nearest integer, the sum is positive so truncation rounds down
+		int n = (int) (x + 128.5f) - 128;
+		float f = (x - (float) n) * 0.693147181f;
+		// e^f for |f| <= ln 2 / 2
+		float p = 1.0f + f * (1.0f + f * (0.5f + f * (1.0f / 6.0f + f * (1.0f / 24.0f + f * (1.0f / 120.0f + f * (1.0f / 720.0f))))));
+		uint32_t bits = (uint32_t) (n + 127) << 23;
+		float scale;
+		std::memcpy(&scale, &bits, sizeof(scale));
+		return p * scale;
+	}
+
+	// the curve's argument is kept in range for the lanes that take the linear segment
+	inline float srgbToLinearFast(float v) {
+		float base = (v + 0.055f) * (1.0f / 1.055f);
+		float curve = fastExp2(2.4f * fastLog2(blend(base < FLT_MIN, FLT_MIN, base)));
+		return blend(v <= 0.04045f, v * (1.0f / 12.92f), curve);
+	}
+
+	inline float linearToSrgbFast(float v) {
+		float curve = 1.055f * fastExp2(fastLog2(blend(v < FLT_MIN, FLT_MIN, v)) * (1.0f / 2.4f)) - 0.055f;
+		return blend(v <= 0.0031308f, v * 12.92f, curve);
+	}
+
+	// fn over count packed floats, SPAN_BLOCK at a time
+	template<typename Fn>
+	inline void mapFloats(const float* in, float* out, size_t count, Fn fn) {
+		alignas(32) float block[SPAN_BLOCK];
+		for (size_t i = 0; i < count; i += SPAN_BLOCK) {
+			size_t n = std::min((size_t) SPAN_BLOCK, count - i);
+			if (n < SPAN_BLOCK) {
+				std::fill(block, block + SPAN_BLOCK, 0.0f);
+			}
+			std::memcpy(block, in + i, n * sizeof(float));
+			for (int j = 0; j < SPAN_BLOCK; j++) {
+				block[j] = fn(block[j]);
+			}
+			std::memcpy(out + i, block, n * sizeof(float));
+		}
+	}
+
+	// fn(a, b, c) over count packed triples of floats, changing them in place. Each block
+	// is split into one array per member first so the loop over fn reads and writes
+	// consecutive floats.
+	template<typename Fn>
+	inline void mapTriples(const float* in, float* out, size_t count, Fn fn) {
+		alignas(32) float packed[SPAN_BLOCK * 3];
+		alignas(32) float a[SPAN_BLOCK], b[SPAN_BLOCK], c[SPAN_BLOCK];
+		for (size_t i = 0; i < count; i += SPAN_BLOCK) {
+			size_t n = std::min((size_t) SPAN_BLOCK, count - i);
+			if (n < SPAN_BLOCK) {
+				std::fill(packed, packed + SPAN_BLOCK * 3, 0.0f);
+			}
+			std::memcpy(packed, in + i * 3, n * 3 * sizeof(float));
+			for (int j = 0; j < SPAN_BLOCK; j++) {
+				a[j] = packed[j * 3];
+				b[j] = packed[j * 3 + 1];
+				c[j] = packed[j * 3 + 2];
+			}
+			for (int j = 0; j < SPAN_BLOCK; j++) {
+				fn(a[j], b[j], c[j]);
+			}
+			for (int j = 0; j < SPAN_BLOCK; j++) {
+				packed[j * 3] = a[j];
+				packed[j * 3 + 1] = b[j];
+				packed[j * 3 + 2] = c[j];
+			}
+			std::memcpy(out + i * 3, packed, n * 3 * sizeof(float));
+		}
+	}
+
+	void toLinear(const Color3* in, Color3* out, size_t count) {
+		mapFloats((const float*) in, (float*) out, count * 3, [](float v) { return srgbToLinearFast(v); });
+	};
+
+	void toSRGB(const Color3* in, Color3* out, size_t count) {
+		mapFloats((const float*) in, (float*) out, count * 3, [](float v) { return linearToSrgbFast(v); });
+	};
+
+	void toHSV(const Color3* in, Hsv* out, size_t count) {
+		mapTriples((const float*) in, (float*) out, count, [](float& r, float& g, float& b) {
+			Hsv hsv = toHSV(Color3(r, g, b));
+			r = hsv.H;
+			g = hsv.S;
+			b = hsv.V;
+		});
+	};
+
+	void fromHSV(const Hsv* in, Color3* out, size_t count) {
+		mapTriples((const float*) in, (float*) out, count, [](float& h, float& s, float& v) {
+			float hh = h / 60.0f;
+			float r = hsvChannel(5.0f, hh, s, v);
+			float g = hsvChannel(3.0f, hh, s, v);
+			float b = hsvChannel(1.0f, hh, s, v);
+			h = r;
+			s = g;
+			v = b;
+		});
+	};
+
+	void toHex(const Color3* in, int* out, size_t count) {
+		alignas(32) float channels[SPAN_BLOCK * 3];
+		alignas(32) int bytes[SPAN_BLOCK * 3];
+		alignas(32) int hex[SPAN_BLOCK];
+		for (size_t i = 0; i < count; i += SPAN_BLOCK) {
+			size_t n = std::min((size_t) SPAN_BLOCK, count - i);
+			if (n < SPAN_BLOCK) {
+				std::fill(channels, channels + SPAN_BLOCK * 3, 0.0f);
+			}
+			std::memcpy(channels, in + i, n * sizeof(Color3));
+			for (int j = 0; j < SPAN_BLOCK * 3; j++) {
+				bytes[j] = toByte(channels[j]);
+			}
+			for (int j = 0; j < SPAN_BLOCK; j++) {
+				hex[j] = (bytes[j * 3] << 16) | (bytes[j * 3 + 1] << 8) | bytes[j * 3 + 2];
+			}
+			std::memcpy(out + i, hex, n * sizeof(int));
+		}
+	};
+
+	void fromHex(const int* in, Color3* out, size_t count) {
+		alignas(32) int hex[SPAN_BLOCK * 3];
+		alignas(32) float channels[SPAN_BLOCK * 3];
+		for (size_t i = 0; i < count; i += SPAN_BLOCK) {
+			size_t n = std::min((size_t) SPAN_BLOCK, count - i);
+			for (size_t j = 0; j < SPAN_BLOCK; j++) {
+				int value = j < n ? in[i + j] : 0;
+				hex[j * 3] = value >> 16;
+				hex[j * 3 + 1] = value >> 8;
+				hex[j * 3 + 2] = value;
+			}
+			for (int j = 0; j < SPAN_BLOCK * 3; j++) {
+				channels[j] = (float) (hex[j] & 0xFF) / 255.0f;
+			}
+			std::memcpy(out + i, channels, n * sizeof(Color3));
+		}
+	};
+
+	void toRGBA8(const Color3* in, unsigned char* out, size_t count) {
+		alignas(32) float channels[SPAN_BLOCK * 3];
+		alignas(32) int bytes[SPAN_BLOCK * 3];
+		for (size_t i = 0; i < count; i += SPAN_BLOCK) {
+			size_t n = std::min((size_t) SPAN_BLOCK, count - i);
+			if (n < SPAN_BLOCK) {
+				std::fill(channels, channels + SPAN_BLOCK * 3, 0.0f);
+			}
+			std::memcpy(channels, in + i, n * sizeof(Color3));
+			for (int j = 0; j < SPAN_BLOCK * 3; j++) {
+				bytes[j] = toByte(channels[j]);
+			}
+			for (size_t j = 0; j < n; j++) {
+				out[(i + j) * 4] = (unsigned char) bytes[j * 3];
+				out[(i + j) * 4 + 1] = (unsigned char) bytes[j * 3 + 1];
+				out[(i + j) * 4 + 2] = (unsigned char) bytes[j * 3 + 2];
+				out[(i + j) * 4 + 3] = 255;
+			}
+		}
+	};
+
+	void fromRGBA8(const unsigned char* in, Color3* out, size_t count) {
+		for (size_t i = 0; i < count; i++) {
+			out[i] = Color3((int) in[i * 4], (int) in[i * 4 + 1], (int) in[i * 4 + 2]);
+		}
+	};
+
+	void fromRGBA8Linear(const unsigned char* in, Color3* out, size_t count) {
+		static const struct Table {
+			float values[256];
+			Table() {
+				for (int i = 0; i < 256; i++) {
+					this->values[i] = srgbToLinear(i / 255.0f);
+				}
+			}
+		} table;
+		for (size_t i = 0; i < count; i++) {
+			out[i] = Color3(table.values[in[i * 4]], table.values[in[i * 4 + 1]], table.values[in[i * 4 + 2]]);
+		}
+	};
+
+}
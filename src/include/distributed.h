@@ -0,0 +1,392 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "raylib.h"
+#include "jobs.h"
+#include "scene.h"
+#include "scenes.h"
+#include "camera.h"
+#include "options.h"
+#include "renderer.h"
+#include "sampler.h"
+#include "socket.h"
+
+namespace tracer {
+
+	// Structs //
+	// Wire format, sent as raw structs: every node has to run the same build on the same
+	// kind of machine, which the magic and version check on connect.
+	static const unsigned int DISTRIBUTED_MAGIC = 0x4b575254;   // "TRWK"
+	static const int DISTRIBUTED_VERSION = 3;
+
+	// everything a worker needs for the tiles of one render, sent once per connection.
+	// Workers build the scene from its name, so all nodes render the same geometry.
+	struct RenderJobHeader {
+		unsigned int magic;
+		int version;
+		char scene[64];
+		int width;
+		int height;
+		int maxSamples;
+		int minSamples;
+		float errorThreshold;
+		unsigned int seed;
+		char sampler[16];      // a createSampler name, anything else is hashed jitter
+		Vector3 cameraPosition;
+		Vector3 cameraRight;
+		Vector3 cameraUp;
+		Vector3 cameraForward;
+		float fieldOfView;
+	};
+
+	// index -1 ends the job
+	struct TileRequest {
+		int index;
+		int x0;
+		int y0;
+		int width;
+		int height;
+	};
+
+	// followed by width * height Vector3 of linear radiance
+	struct TileReply {
+		int index;
+		int width;
+		int height;
+		long long samples;
+	};
+
+	struct WorkerStats {
+		int tiles;
+		long long samples;
+		bool lost;       // timed out or dropped, its tiles went back to the queue
+	};
+
+	// Classes //
+	// Listens for workers and hands each connection tiles from one shared queue, keeping
+	// inFlight requests outstanding per worker so none idles on the round trip. Workers
+	// may join at any time. One whose reply is later than tileTimeout, or that drops the
+	// connection, is cut off and its outstanding tiles go back to the front of the queue
+	// for the others. A tile is merged into the frame the first time it comes back.
+	class Coordinator {
+		public:
+			int tileSize;
+			int inFlight;
+			double tileTimeout;    // seconds
+			std::vector<WorkerStats> workers;
+			double wallSeconds;
+
+			Coordinator(Socket* listener);
+			~Coordinator();
+
+			// blocks until every tile of the job is in pixels, width * height of them
+			bool render(const RenderJobHeader& job, Vector3* pixels);
+
+		private:
+			Socket* listener;
+			std::mutex lock;
+			std::condition_variable changed;
+			std::deque<int> queue;
+			std::vector<unsigned char> done;
+			int remaining;
+
+			void serve(Socket* client, int workerIndex, const RenderJobHeader& job, Vector3* pixels);
+			TileRequest tileRequest(const RenderJobHeader& job, int index);
+	};
+
+	// Renders tiles for coordinators until none is reachable for retrySeconds. Tiles are
+	// split across the local job system by rows.
+	class Worker {
+		public:
+			double retrySeconds;
+			int tilesRendered;
+
+			Worker();
+			~Worker();
+
+			// false only when no coordinator was ever reached
+			bool run(const std::string& address);
+
+		private:
+			std::string sceneName;
+			Scene* scene;
+
+			bool serve(Socket* connection);
+	};
+
+	// Methods //
+	// the settings a local render of options would use, the coordinator itself builds no scene
+	RenderJobHeader makeRenderJob(const RenderOptions& options, const RenderCamera& camera);
+
+	RenderJobHeader makeRenderJob(const RenderOptions& options, const RenderCamera& camera) {
+		RenderJobHeader job;
+		std::memset(&job, 0, sizeof(job));
+		job.magic = DISTRIBUTED_MAGIC;
+		job.version = DISTRIBUTED_VERSION;
+		std::strncpy(job.scene, options.scene.c_str(), sizeof(job.scene) - 1);
+		job.width = options.width;
+		job.height = options.height;
+		job.maxSamples = options.samples;
+		job.minSamples = std::min(TileRenderer::DEFAULT_MIN_SAMPLES, options.samples);
+		job.errorThreshold = options.threshold;
+		job.seed = options.seed;
+		std::strncpy(job.sampler, options.sampler.c_str(), sizeof(job.sampler) - 1);
+		job.cameraPosition = camera.position;
+		job.cameraRight = camera.right;
+		job.cameraUp = camera.up;
+		job.cameraForward = camera.forward;
+		job.fieldOfView = camera.fieldOfView;
+		return job;
+	}
+
+	// Coordinator //
+	Coordinator::Coordinator(Socket* listener) {
+		this->listener = listener;
+		this->tileSize = 64;
+		this->inFlight = 2;
+		this->tileTimeout = 60.0;
+		this->wallSeconds = 0.0;
+		this->remaining = 0;
+	};
+
+	Coordinator::~Coordinator() {
+
+	};
+
+	TileRequest Coordinator::tileRequest(const RenderJobHeader& job, int index) {
+		int tilesX = (job.width + this->tileSize - 1) / this->tileSize;
+		TileRequest request;
+		request.index = index;
+		request.x0 = (index % tilesX) * this->tileSize;
+		request.y0 = (index / tilesX) * this->tileSize;
+		request.width = std::min(this->tileSize, job.width - request.x0);
+		request.height = std::min(this->tileSize, job.height - request.y0);
+		return request;
+	};
+
+	bool Coordinator::render(const RenderJobHeader& job, Vector3* pixels) {
+		auto start = std::chrono::steady_clock::now();
+		int tilesX = (job.width + this->tileSize - 1) / this->tileSize;
+		int tilesY = (job.height + this->tileSize - 1) / this->tileSize;
+		this->queue.clear();
+		for (int i = 0; i < tilesX * tilesY; i++) {
+			this->queue.push_back(i);
+		}
+		this->done.assign(tilesX * tilesY, 0);
+		this->remaining = tilesX * tilesY;
+		this->workers.clear();
+
+		std::vector<std::thread> connections;
+		while (true) {
+			{
+				std::lock_guard<std::mutex> guard(this->lock);
+				if (this->remaining == 0) {
+					break;
+				}
+			}
+			Socket* client = this->listener->accept(100);
+			if (client == NULL) {
+				continue;
+			}
+			int workerIndex;
+			{
+				std::lock_guard<std::mutex> guard(this->lock);
+				workerIndex = (int) this->workers.size();
+				this->workers.push_back({ 0, 0, false });
+			}
+			connections.emplace_back([this, client, workerIndex, &job, pixels]() {
+				this->serve(client, workerIndex, job, pixels);
+			});
+		}
+		for (std::thread& connection : connections) {
+			connection.join();
+		}
+		this->wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		return true;
+	};
+
+	void Coordinator::serve(Socket* client, int workerIndex, const RenderJobHeader& job, Vector3* pixels) {
+		std::deque<int> outstanding;
+		std::vector<Vector3> tile((size_t) this->tileSize * this->tileSize);
+		int timeoutMs = (int) (this->tileTimeout * 1000.0);
+		unsigned int hello[2] = { 0, 0 };
+		bool ok = client->receiveAll(hello, sizeof(hello), timeoutMs) && hello[0] == DISTRIBUTED_MAGIC && (int) hello[1] == DISTRIBUTED_VERSION
+			&& client->sendAll(&job, sizeof(job));
+
+		while (ok) {
+			// top the worker up to inFlight requests, or end its job once everything is in
+			std::vector<int> taken;
+			{
+				std::unique_lock<std::mutex> guard(this->lock);
+				if (outstanding.empty()) {
+					this->changed.wait_for(guard, std::chrono::milliseconds(100), [this]() {
+						return !this->queue.empty() || this->remaining == 0;
+					});
+					if (this->remaining == 0) {
+						break;
+					}
+				}
+				while ((int) (outstanding.size() + taken.size()) < this->inFlight && !this->queue.empty()) {
+					taken.push_back(this->queue.front());
+					this->queue.pop_front();
+				}
+			}
+			for (int index : taken) {
+				TileRequest request = this->tileRequest(job, index);
+				outstanding.push_back(index);
+				ok = ok && client->sendAll(&request, sizeof(request));
+			}
+			if (!ok || outstanding.empty()) {
+				continue;
+			}
+
+			// replies come back in request order
+			TileRequest expected = this->tileRequest(job, outstanding.front());
+			TileReply reply;
+			ok = client->receiveAll(&reply, sizeof(reply), timeoutMs) && reply.index == expected.index
+				&& reply.width == expected.width && reply.height == expected.height
+				&& client->receiveAll(tile.data(), (size_t) reply.width * reply.height * sizeof(Vector3), timeoutMs);
+			if (!ok) {
+				break;
+			}
+			outstanding.pop_front();
+
+			std::lock_guard<std::mutex> guard(this->lock);
+			if (!this->done[reply.index]) {
+				for (int y = 0; y < reply.height; y++) {
+					std::memcpy(pixels + (size_t) (expected.y0 + y) * job.width + expected.x0, &tile[(size_t) y * reply.width], reply.width * sizeof(Vector3));
+				}
+				this->done[reply.index] = 1;
+				this->remaining -= 1;
+				this->changed.notify_all();
+			}
+			this->workers[workerIndex].tiles += 1;
+			this->workers[workerIndex].samples += reply.samples;
+		}
+
+		if (ok) {
+			TileRequest end = { -1, 0, 0, 0, 0 };
+			client->sendAll(&end, sizeof(end));
+		} else {
+			// whatever this worker still had goes to the others first
+			std::lock_guard<std::mutex> guard(this->lock);
+			int requeued = 0;
+			for (auto it = outstanding.rbegin(); it != outstanding.rend(); ++it) {
+				if (!this->done[*it]) {
+					this->queue.push_front(*it);
+					requeued++;
+				}
+			}
+			this->workers[workerIndex].lost = true;
+			this->changed.notify_all();
+			std::cerr << "worker " << workerIndex << " lost, " << requeued << " tiles reassigned" << std::endl;
+		}
+		delete(client);
+	};
+
+	// Worker //
+	Worker::Worker() {
+		this->retrySeconds = 5.0;
+		this->tilesRendered = 0;
+		this->scene = NULL;
+	};
+
+	Worker::~Worker() {
+		delete(this->scene);
+	};
+
+	bool Worker::run(const std::string& address) {
+		bool reached = false;
+		auto lastContact = std::chrono::steady_clock::now();
+		while (std::chrono::duration<double>(std::chrono::steady_clock::now() - lastContact).count() < this->retrySeconds) {
+			Socket* connection = Socket::connect(address);
+			if (connection == NULL) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(200));
+				continue;
+			}
+			reached = true;
+			// only a coordinator that handed out work counts as contact, one that never
+			// sends a job is given up on like an unreachable one
+			int rendered = this->tilesRendered;
+			bool finished = this->serve(connection);
+			delete(connection);
+			if (finished || this->tilesRendered > rendered) {
+				lastContact = std::chrono::steady_clock::now();
+			}
+		}
+		return reached;
+	};
+
+	// one job: the header, then tile requests until the end marker or a lost connection
+	bool Worker::serve(Socket* connection) {
+		unsigned int hello[2] = { DISTRIBUTED_MAGIC, (unsigned int) DISTRIBUTED_VERSION };
+		RenderJobHeader job;
+		// a coordinator that accepted but never sends its job must not hold the worker forever
+		int timeoutMs = (int) (this->retrySeconds * 1000.0);
+		if (!connection->sendAll(hello, sizeof(hello)) || !connection->receiveAll(&job, sizeof(job), timeoutMs)
+			|| job.magic != DISTRIBUTED_MAGIC || job.version != DISTRIBUTED_VERSION) {
+			return false;
+		}
+		job.scene[sizeof(job.scene) - 1] = '\0';
+		if (this->scene == NULL || this->sceneName != job.scene) {
+			delete(this->scene);
+			this->scene = buildScene(job.scene);
+			this->sceneName = job.scene;
+			if (this->scene == NULL) {
+				std::cerr << "unknown scene " << job.scene << std::endl;
+				return false;
+			}
+		}
+
+		TileRenderer renderer(this->scene, NULL);
+		renderer.maxSamples = job.maxSamples;
+		renderer.minSamples = job.minSamples;
+		renderer.errorThreshold = job.errorThreshold;
+		renderer.seed = job.seed;
+		job.sampler[sizeof(job.sampler) - 1] = '\0';
+		renderer.sampler = createSampler(job.sampler, job.seed);
+		renderer.camera.position = job.cameraPosition;
+		renderer.camera.right = job.cameraRight;
+		renderer.camera.up = job.cameraUp;
+		renderer.camera.forward = job.cameraForward;
+		renderer.camera.fieldOfView = job.fieldOfView;
+
+		std::vector<Vector3> tile;
+		TileRequest request;
+		while (connection->receiveAll(&request, sizeof(request), -1)) {
+			if (request.index < 0) {
+				return true;
+			}
+			tile.resize((size_t) request.width * request.height);
+			std::atomic<long long> samples(0);
+			renderer.pool->parallelFor(0, request.height, 1, [&](int first, int last) {
+				long long taken = 0;
+				for (int y = first; y < last; y++) {
+					for (int x = 0; x < request.width; x++) {
+						int n = 0;
+						tile[(size_t) y * request.width + x] = renderer.samplePixel(request.x0 + x, request.y0 + y, job.width, job.height, &n);
+						taken += n;
+					}
+				}
+				samples.fetch_add(taken);
+			});
+
+			TileReply reply = { request.index, request.width, request.height, samples.load() };
+			if (!connection->sendAll(&reply, sizeof(reply)) || !connection->sendAll(tile.data(), tile.size() * sizeof(Vector3))) {
+				return false;
+			}
+			this->tilesRendered += 1;
+		}
+		return false;
+	};
+
+};
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+#include "raylib.h"
+
+namespace geometry {
+
+	// Vector Helpers //
+	// value-type helpers over raylib's Vector3 so the hot paths never allocate
+	inline Vector3 vec3(float x, float y, float z) { return { x, y, z }; }
+	inline Vector3 add(Vector3 a, Vector3 b) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+	inline Vector3 sub(Vector3 a, Vector3 b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+	inline Vector3 mul(Vector3 a, float s) { return { a.x * s, a.y * s, a.z * s }; }
+	inline Vector3 mul(Vector3 a, Vector3 b) { return { a.x * b.x, a.y * b.y, a.z * b.z }; }
+	inline Vector3 neg(Vector3 a) { return { -a.x, -a.y, -a.z }; }
+	inline float dot(Vector3 a, Vector3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+	inline float length(Vector3 a) { return std::sqrt(dot(a, a)); }
+	inline Vector3 vmin(Vector3 a, Vector3 b) { return { std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z) }; }
+	inline Vector3 vmax(Vector3 a, Vector3 b) { return { std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z) }; }
+
+	inline Vector3 cross(Vector3 a, Vector3 b) {
+		return {
+			a.y * b.z - a.z * b.y,
+			a.z * b.x - a.x * b.z,
+			a.x * b.y - a.y * b.x
+		};
+	}
+
+	inline Vector3 normalize(Vector3 a) {
+		float len = length(a);
+		if (len == 0.0f) {
+			return { 0.0f, 0.0f, 0.0f };
+		}
+		return mul(a, 1.0f / len);
+	}
+
+	inline float component(Vector3 a, int axis) {
+		return (axis == 0) ? a.x : (axis == 1) ? a.y : a.z;
+	}
+
+	inline Vector3 rayAt(const Ray& ray, float t) {
+		return add(ray.position, mul(ray.direction, t));
+	}
+
+	// Bounds //
+	inline BoundingBox emptyBounds() {
+		return { { FLT_MAX, FLT_MAX, FLT_MAX }, { -FLT_MAX, -FLT_MAX, -FLT_MAX } };
+	}
+
+	inline void grow(BoundingBox* box, Vector3 p) {
+		box->min = vmin(box->min, p);
+		box->max = vmax(box->max, p);
+	}
+
+	inline BoundingBox merge(BoundingBox a, BoundingBox b) {
+		return { vmin(a.min, b.min), vmax(a.max, b.max) };
+	}
+
+	inline Vector3 centroid(BoundingBox box) {
+		return mul(add(box.min, box.max), 0.5f);
+	}
+
+	inline float surfaceArea(BoundingBox box) {
+		Vector3 e = sub(box.max, box.min);
+		if (e.x < 0 || e.y < 0 || e.z < 0) {
+			return 0.0f;
+		}
+		return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+	}
+
+	inline Vector3 inverseDirection(Vector3 d) {
+		// infinities are fine here, the slab test below handles them
+		return { 1.0f / d.x, 1.0f / d.y, 1.0f / d.z };
+	}
+
+	// slab test, returns the entry distance through tNear when the box is hit before tMax
+	inline bool intersectBounds(const Ray& ray, Vector3 invDir, BoundingBox box, float tMax, float* tNear) {
+		float tx1 = (box.min.x - ray.position.x) * invDir.x;
+		float tx2 = (box.max.x - ray.position.x) * invDir.x;
+		float t0 = std::min(tx1, tx2);
+		float t1 = std::max(tx1, tx2);
+
+		float ty1 = (box.min.y - ray.position.y) * invDir.y;
+		float ty2 = (box.max.y - ray.position.y) * invDir.y;
+		t0 = std::max(t0, std::min(ty1, ty2));
+		t1 = std::min(t1, std::max(ty1, ty2));
+
+		float tz1 = (box.min.z - ray.position.z) * invDir.z;
+		float tz2 = (box.max.z - ray.position.z) * invDir.z;
+		t0 = std::max(t0, std::min(tz1, tz2));
+		t1 = std::min(t1, std::max(tz1, tz2));
+
+		*tNear = std::max(t0, 0.0f);
+		return t1 >= *tNear && t0 < tMax;
+	}
+
+	// Hits //
+	struct HitRecord {
+		bool hit;
+		float distance;
+		Vector3 point;
+		Vector3 normal;
+		Vector2 uv;
+		float u, v;          // barycentrics (or primitive local coordinates)
+		int objectId;
+		int primitiveId;     // triangle index for meshes, cell index for grids
+	};
+
+	inline HitRecord emptyHit() {
+		HitRecord hit;
+		hit.hit = false;
+		hit.distance = FLT_MAX;
+		hit.point = { 0.0f, 0.0f, 0.0f };
+		hit.normal = { 0.0f, 0.0f, 0.0f };
+		hit.uv = { 0.0f, 0.0f };
+		hit.u = 0.0f;
+		hit.v = 0.0f;
+		hit.objectId = -1;
+		hit.primitiveId = -1;
+		return hit;
+	}
+
+	// Moller-Trumbore, writes distance and barycentrics of p1 / p2 on a hit closer than tMax
+	inline bool intersectTriangle(const Ray& ray, Vector3 p0, Vector3 p1, Vector3 p2, float tMax, float* t, float* u, float* v) {
+		const float epsilon = 1e-8f;
+
+		Vector3 e1 = sub(p1, p0);
+		Vector3 e2 = sub(p2, p0);
+		Vector3 p = cross(ray.direction, e2);
+		float det = dot(e1, p);
+		if (std::fabs(det) < epsilon) {
+			return false;
+		}
+
+		float invDet = 1.0f / det;
+		Vector3 s = sub(ray.position, p0);
+		float bu = dot(s, p) * invDet;
+		if (bu < 0.0f || bu > 1.0f) {
+			return false;
+		}
+
+		Vector3 q = cross(s, e1);
+		float bv = dot(ray.direction, q) * invDet;
+		if (bv < 0.0f || bu + bv > 1.0f) {
+			return false;
+		}
+
+		float dist = dot(e2, q) * invDet;
+		if (dist <= epsilon || dist >= tMax) {
+			return false;
+		}
+
+		*t = dist;
+		*u = bu;
+		*v = bv;
+		return true;
+	}
+
+};
@@ -0,0 +1,344 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "raylib.h"
+#include "geometry.h"
+#include "scene.h"
+
+namespace tracer {
+
+	// Structs //
+	struct HeightRange {
+		uint8_t lo;
+		uint8_t hi;
+	};
+
+	// Classes //
+	// Height field traced straight from 8-bit samples, laid out like GenMeshHeightmap: the
+	// terrain spans position .. position + size and a sample of 255 is size.y high.
+	// A min-max mip pyramid over 2x2 cell blocks (level 1 and up, level 0 is derived from the
+	// four corner samples on the fly) lets the traversal skip everything the ray passes above
+	// or below, and cells are intersected exactly as bilinear patches.
+	class HeightField : public SceneObject {
+		public:
+			static const int STACK_SIZE = 128;
+
+			int width;               // samples
+			int height;
+			Vector3 position;
+			Vector3 size;
+			std::vector<uint8_t> samples;
+			std::vector<std::vector<HeightRange>> levels; // levels[k] covers blocks of 2^(k+1) cells
+
+			HeightField(Image* image, Vector3 position, Vector3 size);
+			HeightField(const std::vector<uint8_t>& samples, int width, int height, Vector3 position, Vector3 size);
+			~HeightField();
+
+			void toDefault();
+			void buildLevels();
+
+			int cellsX();
+			int cellsZ();
+			int levelCount();
+			float sampleHeight(int x, int z);
+			HeightRange range(int level, int ix, int iz);
+			BoundingBox nodeBounds(int level, int ix, int iz);
+
+			BoundingBox bounds();
+			bool intersect(const Ray& ray, float tMax, geometry::HitRecord* hit);
+			void fillSurface(const Ray& ray, geometry::HitRecord* hit);
+			size_t memoryUsage();
+
+		private:
+			float cellSizeX;
+			float cellSizeZ;
+			float heightScale;
+
+			int levelWidth(int level);
+			int levelHeight(int level);
+			bool intersectCell(const Ray& ray, float tMin, int cx, int cz, float tEnter, float tExit, float* t, float* u, float* v);
+	};
+
+	HeightField::HeightField(Image* image, Vector3 position, Vector3 size) {
+		this->toDefault();
+		this->width = image->width;
+		this->height = image->height;
+		this->position = position;
+		this->size = size;
+		this->samples.resize((size_t) this->width * this->height);
+
+		size_t count = this->samples.size();
+		const unsigned char* data = (const unsigned char*) image->data;
+		if (image->format == PIXELFORMAT_UNCOMPRESSED_GRAYSCALE) {
+			std::copy(data, data + count, this->samples.begin());
+		} else if (image->format == PIXELFORMAT_UNCOMPRESSED_R8G8B8A8 || image->format == PIXELFORMAT_UNCOMPRESSED_R8G8B8) {
+			int stride = (image->format == PIXELFORMAT_UNCOMPRESSED_R8G8B8A8) ? 4 : 3;
+			for (size_t i = 0; i < count; i++) {
+				const unsigned char* px = data + i * stride;
+				this->samples[i] = (uint8_t) ((px[0] + px[1] + px[2]) / 3);
+			}
+		} else {
+			// any other format goes through raylib's converter, same gray value as GenMeshHeightmap
+			Color* colors = LoadImageColors(*image);
+			for (size_t i = 0; i < count; i++) {
+				this->samples[i] = (uint8_t) ((colors[i].r + colors[i].g + colors[i].b) / 3);
+			}
+			UnloadImageColors(colors);
+		}
+
+		this->buildLevels();
+	};
+
+	HeightField::HeightField(const std::vector<uint8_t>& samples, int width, int height, Vector3 position, Vector3 size) {
+		this->toDefault();
+		this->width = width;
+		this->height = height;
+		this->position = position;
+		this->size = size;
+		this->samples = samples;
+		this->buildLevels();
+	};
+
+	HeightField::~HeightField() {
+
+	};
+
+	void HeightField::toDefault() {
+		this->width = 0;
+		this->height = 0;
+		this->position = { 0, 0, 0 };
+		this->size = { 1, 1, 1 };
+		this->samples.clear();
+		this->levels.clear();
+		this->cellSizeX = 0;
+		this->cellSizeZ = 0;
+		this->heightScale = 0;
+	};
+
+	int HeightField::cellsX() {
+		return std::max(1, this->width - 1);
+	};
+
+	int HeightField::cellsZ() {
+		return std::max(1, this->height - 1);
+	};
+
+	int HeightField::levelCount() {
+		return (int) this->levels.size() + 1;
+	};
+
+	int HeightField::levelWidth(int level) {
+		return ((this->cellsX() - 1) >> level) + 1;
+	};
+
+	int HeightField::levelHeight(int level) {
+		return ((this->cellsZ() - 1) >> level) + 1;
+	};
+
+	void HeightField::buildLevels() {
+		this->levels.clear();
+		this->cellSizeX = this->size.x / (float) this->cellsX();
+		this->cellSizeZ = this->size.z / (float) this->cellsZ();
+		this->heightScale = this->size.y / 255.0f;
+
+		int level = 1;
+		while (this->levelWidth(level - 1) > 1 || this->levelHeight(level - 1) > 1) {
+			int lw = this->levelWidth(level);
+			int lh = this->levelHeight(level);
+			std::vector<HeightRange> ranges((size_t) lw * lh);
+
+			for (int iz = 0; iz < lh; iz++) {
+				for (int ix = 0; ix < lw; ix++) {
+					HeightRange r = { 255, 0 };
+					for (int k = 0; k < 4; k++) {
+						int cx = ix * 2 + (k & 1);
+						int cz = iz * 2 + (k >> 1);
+						if (cx >= this->levelWidth(level - 1) || cz >= this->levelHeight(level - 1)) {
+							continue;
+						}
+						HeightRange child = this->range(level - 1, cx, cz);
+						r.lo = std::min(r.lo, child.lo);
+						r.hi = std::max(r.hi, child.hi);
+					}
+					ranges[(size_t) iz * lw + ix] = r;
+				}
+			}
+
+			this->levels.push_back(ranges);
+			level++;
+		}
+	};
+
+	float HeightField::sampleHeight(int x, int z) {
+		x = std::min(x, this->width - 1);
+		z = std::min(z, this->height - 1);
+		return this->position.y + (float) this->samples[(size_t) z * this->width + x] * this->heightScale;
+	};
+
+	HeightRange HeightField::range(int level, int ix, int iz) {
+		if (level > 0) {
+			return this->levels[level - 1][(size_t) iz * this->levelWidth(level) + ix];
+		}
+		int x1 = std::min(ix + 1, this->width - 1);
+		int z1 = std::min(iz + 1, this->height - 1);
+		uint8_t s00 = this->samples[(size_t) iz * this->width + ix];
+		uint8_t s10 = this->samples[(size_t) iz * this->width + x1];
+		uint8_t s01 = this->samples[(size_t) z1 * this->width + ix];
+		uint8_t s11 = this->samples[(size_t) z1 * this->width + x1];
+		return { std::min(std::min(s00, s10), std::min(s01, s11)), std::max(std::max(s00, s10), std::max(s01, s11)) };
+	};
+
+	BoundingBox HeightField::nodeBounds(int level, int ix, int iz) {
+		HeightRange r = this->range(level, ix, iz);
+		int x0 = ix << level, x1 = std::min((ix + 1) << level, this->cellsX());
+		int z0 = iz << level, z1 = std::min((iz + 1) << level, this->cellsZ());
+		return {
+			{ this->position.x + x0 * this->cellSizeX, this->position.y + r.lo * this->heightScale, this->position.z + z0 * this->cellSizeZ },
+			{ this->position.x + x1 * this->cellSizeX, this->position.y + r.hi * this->heightScale, this->position.z + z1 * this->cellSizeZ }
+		};
+	};
+
+	BoundingBox HeightField::bounds() {
+		return this->nodeBounds(this->levelCount() - 1, 0, 0);
+	};
+
+	bool HeightField::intersectCell(const Ray& ray, float tMin, int cx, int cz, float tEnter, float tExit, float* t, float* u, float* v) {
+		// bilinear patch y = a + b*u + c*v + d*u*v in cell local u, v
+		float a = this->sampleHeight(cx, cz);
+		float b = this->sampleHeight(cx + 1, cz) - a;
+		float c = this->sampleHeight(cx, cz + 1) - a;
+		float d = this->sampleHeight(cx + 1, cz + 1) - a - b - c;
+
+		double ou = (ray.position.x - (this->position.x + cx * this->cellSizeX)) / this->cellSizeX;
+		double ov = (ray.position.z - (this->position.z + cz * this->cellSizeZ)) / this->cellSizeZ;
+		double du = ray.direction.x / this->cellSizeX;
+		double dv = ray.direction.z / this->cellSizeZ;
+
+		double qa = -d * du * dv;
+		double qb = ray.direction.y - b * du - c * dv - d * (ou * dv + ov * du);
+		double qc = ray.position.y - a - b * ou - c * ov - d * ou * ov;
+
+		const double slack = 1e-5;
+		double roots[2];
+		int count = geometry::solveQuadratic(qa, qb, qc, roots);
+		for (int i = 0; i < count; i++) {
+			double tr = roots[i];
+			if (tr < tEnter - slack || tr > tExit + slack || tr <= tMin) {
+				continue;
+			}
+			double pu = ou + du * tr;
+			double pv = ov + dv * tr;
+			if (pu < -slack || pu > 1.0 + slack || pv < -slack || pv > 1.0 + slack) {
+				continue;
+			}
+			*t = (float) tr;
+			*u = (float) std::max(0.0, std::min(1.0, pu));
+			*v = (float) std::max(0.0, std::min(1.0, pv));
+			return true;
+		}
+		return false;
+	};
+
+	bool HeightField::intersect(const Ray& ray, float tMax, geometry::HitRecord* hit) {
+		const float tMin = 1e-4f;
+		Vector3 invDir = geometry::inverseDirection(ray.direction);
+		int top = this->levelCount() - 1;
+
+		float tNear;
+		if (!geometry::intersectBounds(ray, invDir, this->nodeBounds(top, 0, 0), tMax, &tNear)) {
+			return false;
+		}
+
+		struct Entry { int level, ix, iz; float tNear; };
+		Entry stack[STACK_SIZE];
+		int stackSize = 0;
+		stack[stackSize++] = { top, 0, 0, tNear };
+
+		bool found = false;
+		while (stackSize > 0) {
+			Entry node = stack[--stackSize];
+			if (node.tNear >= tMax) {
+				continue;
+			}
+
+			if (node.level == 0) {
+				// exit distance of the cell column, the patch root has to lie inside it
+				BoundingBox box = this->nodeBounds(0, node.ix, node.iz);
+				box.min.y = -FLT_MAX;
+				box.max.y = FLT_MAX;
+				float tx1 = (box.min.x - ray.position.x) * invDir.x, tx2 = (box.max.x - ray.position.x) * invDir.x;
+				float tz1 = (box.min.z - ray.position.z) * invDir.z, tz2 = (box.max.z - ray.position.z) * invDir.z;
+				float tExit = std::min(tMax, std::min(std::isnan(tx1) ? FLT_MAX : std::max(tx1, tx2), std::isnan(tz1) ? FLT_MAX : std::max(tz1, tz2)));
+
+				float t, u, v;
+				if (this->intersectCell(ray, tMin, node.ix, node.iz, node.tNear, tExit, &t, &u, &v) && t < tMax) {
+					tMax = t;
+					hit->hit = true;
+					hit->distance = t;
+					hit->u = u;
+					hit->v = v;
+					hit->primitiveId = node.iz * this->cellsX() + node.ix;
+					found = true;
+				}
+				continue;
+			}
+
+			// children sorted so the nearest one is popped first
+			Entry children[4];
+			int childCount = 0;
+			int childLevel = node.level - 1;
+			for (int k = 0; k < 4; k++) {
+				int cx = node.ix * 2 + (k & 1);
+				int cz = node.iz * 2 + (k >> 1);
+				if (cx >= this->levelWidth(childLevel) || cz >= this->levelHeight(childLevel)) {
+					continue;
+				}
+				float tChild;
+				if (geometry::intersectBounds(ray, invDir, this->nodeBounds(childLevel, cx, cz), tMax, &tChild)) {
+					children[childCount++] = { childLevel, cx, cz, tChild };
+				}
+			}
+			for (int k = 1; k < childCount; k++) {
+				Entry e = children[k];
+				int j = k - 1;
+				while (j >= 0 && children[j].tNear < e.tNear) {
+					children[j + 1] = children[j];
+					j--;
+				}
+				children[j + 1] = e;
+			}
+			for (int k = 0; k < childCount; k++) {
+				stack[stackSize++] = children[k];
+			}
+		}
+
+		return found;
+	};
+
+	void HeightField::fillSurface(const Ray& ray, geometry::HitRecord* hit) {
+		int cx = hit->primitiveId % this->cellsX();
+		int cz = hit->primitiveId / this->cellsX();
+		float a = this->sampleHeight(cx, cz);
+		float b = this->sampleHeight(cx + 1, cz) - a;
+		float c = this->sampleHeight(cx, cz + 1) - a;
+		float d = this->sampleHeight(cx + 1, cz + 1) - a - b - c;
+
+		// gradient of the patch in world units
+		float dydx = (b + d * hit->v) / this->cellSizeX;
+		float dydz = (c + d * hit->u) / this->cellSizeZ;
+
+		hit->point = geometry::rayAt(ray, hit->distance);
+		hit->normal = geometry::normalize(geometry::vec3(-dydx, 1.0f, -dydz));
+		hit->uv = { (cx + hit->u) / (float) this->cellsX(), (cz + hit->v) / (float) this->cellsZ() };
+	};
+
+	size_t HeightField::memoryUsage() {
+		size_t total = this->samples.size();
+		for (const std::vector<HeightRange>& level : this->levels) {
+			total += level.size() * sizeof(HeightRange);
+		}
+		return total;
+	};
+
+};
@@ -1,15 +1,43 @@
+#pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <vector>
 #include "raylib.h"
 
 namespace bufferNamespace {
 	
+	// Methods //
+	inline unsigned char toByte(float value) {
+		return (unsigned char) (std::min(1.0f, std::max(0.0f, value)) * 255.0f + 0.5f);
+	}
+
+	inline Color toColor(Vector4 value) {
+		return { toByte(value.x), toByte(value.y), toByte(value.z), toByte(value.w) };
+	}
+
+	inline Vector4 toVector4(Color value) {
+		return { value.r / 255.0f, value.g / 255.0f, value.b / 255.0f, value.a / 255.0f };
+	}
+
+	// Classes //
+	// Triple buffer shared by one render thread and the display thread. The renderer
+	// draws into the write image and publishes it by swapping it with the middle slot,
+	// the display swaps the middle slot with its present image when a newer frame is
+	// there. Neither side ever waits on the other.
+	//
+	// Every slot stamps the CELL_SIZE cells it is written to with the frame number, so
+	// the one persistent texture only receives cells whose stamp differs from what it
+	// already shows, and a recycled write slot only copies the cells it is behind on.
 	class ImageDisplayBuffer {
 		public:
+			static const int FRESH = 4;   // set in middleState when the middle slot holds an unseen frame
+			static constexpr int CELL_SIZE = 32;
+
 			Texture2D activeTexture;
-			Image buffer1;
-			Image buffer2;
-			int bufferState;
-			bool finished;
+			Image buffers[3];
+			size_t uploadedBytes;         // sent to the texture by the last Present
 
 			ImageDisplayBuffer();
 			~ImageDisplayBuffer();
@@ -18,56 +46,369 @@ namespace bufferNamespace {
 
 			void SetImage(Image* ref);
 			void SetPixel(int x, int y, Color* color);
+
+			// Direct access to the write image. Slots are either R8G8B8A8 or R32G32B32A32,
+			// Row / RowFloat return NULL when the format does not match. Pixels stored
+			// through them have to be reported with MarkDirty to reach the screen.
+			bool IsFloat();
+			Color* Row(int y);
+			Vector4* RowFloat(int y);
+			void MarkDirty(int x, int y, int width, int height);
+
+			// bulk stores into the write image, clipped to it, converting when the formats differ.
+			// stride is in pixels between the starts of consecutive source rows
+			void writeRow(int x, int y, const Color* pixels, int count);
+			void writeRow(int x, int y, const Vector4* pixels, int count);
+			void writeTile(int x, int y, int width, int height, const Color* pixels, int stride);
+			void writeTile(int x, int y, int width, int height, const Vector4* pixels, int stride);
 			void SetActive(Image* image);
 			void SetInactive(Image* image);
 			Image* GetActive();
 			Image* GetInactive();
 			
+			// render thread: publish the write image as the newest complete frame
 			void Flip();
-			void SetState(bool finished);
+			// display thread: take the newest frame if there is one and upload it, true when it changed
+			bool Present();
+			// same without touching the texture, for headless use where there is no GL context
+			bool Acquire();
+			bool HasNewFrame();
+
+		private:
+			int writeIndex;                  // owned by the render thread
+			int presentIndex;                // owned by the display thread
+			std::atomic<int> middleState;    // index of the middle slot, plus FRESH
+
+			int cellsX, cellsY;
+			std::atomic<unsigned int>* cellVersions[3];  // per slot, frame that last wrote each cell
+			std::vector<unsigned int> textureVersions;   // display thread, what the texture holds
+			unsigned int drawVersion;                    // render thread, frame being drawn
+			std::vector<unsigned char> staging;
+
+			void releaseSlots();
+			bool replaceSlot(int slot, Image* image);
+			void carryOver(int slot, int source);
+			void upload();
 	};
 
 	ImageDisplayBuffer::ImageDisplayBuffer() { this->toDefault(); }
-	ImageDisplayBuffer::~ImageDisplayBuffer() { }
+	ImageDisplayBuffer::~ImageDisplayBuffer() {
+		if (this->activeTexture.id != 0) {
+			UnloadTexture(this->activeTexture);
+		}
+		this->releaseSlots();
+	}
 
 	void ImageDisplayBuffer::toDefault() {
-		// Image* p = NULL;
-		// Texture2D* t = NULL;
-		// this->buffer1 = *p;
-		// this->buffer2 = *p;
-		// this->activeTexture = *t;
-		this->bufferState = 1;
+		this->activeTexture = { 0 };
+		for (int i = 0; i < 3; i++) {
+			this->buffers[i] = { 0 };
+		}
+		this->writeIndex = 0;
+		this->middleState.store(1);
+		this->presentIndex = 2;
+		this->uploadedBytes = 0;
+		this->cellsX = 0;
+		this->cellsY = 0;
+		for (int i = 0; i < 3; i++) {
+			this->cellVersions[i] = NULL;
+		}
+		this->drawVersion = 1;
+	};
+
+	void ImageDisplayBuffer::releaseSlots() {
+		for (int i = 0; i < 3; i++) {
+			if (this->buffers[i].data != NULL) {
+				UnloadImage(this->buffers[i]);
+				this->buffers[i] = { 0 };
+			}
+			delete[] this->cellVersions[i];
+			this->cellVersions[i] = NULL;
+		}
+	};
+
+	// every slot gets its own copy of ref, the buffer owns them from here on.
+	// Formats other than R8G8B8A8 and R32G32B32A32 are converted to R8G8B8A8.
+	void ImageDisplayBuffer::SetImage(Image* ref) {
+		this->releaseSlots();
+		this->cellsX = (ref->width + CELL_SIZE - 1) / CELL_SIZE;
+		this->cellsY = (ref->height + CELL_SIZE - 1) / CELL_SIZE;
+		for (int i = 0; i < 3; i++) {
+			this->buffers[i] = ImageCopy(*ref);
+			if (ref->format != PIXELFORMAT_UNCOMPRESSED_R8G8B8A8 && ref->format != PIXELFORMAT_UNCOMPRESSED_R32G32B32A32) {
+				ImageFormat(&this->buffers[i], PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+			}
+			this->cellVersions[i] = new std::atomic<unsigned int>[this->cellsX * this->cellsY];
+			for (int c = 0; c < this->cellsX * this->cellsY; c++) {
+				this->cellVersions[i][c].store(0, std::memory_order_relaxed);
+			}
+		}
+		// a texture of another size is replaced on the next Present
+		this->textureVersions.assign(this->cellsX * this->cellsY, 0);
+		this->drawVersion = 1;
 	};
 
 	void ImageDisplayBuffer::SetPixel(int x, int y, Color* color) {
-		ImageDrawPixel(this->GetInactive(), x, y, *color);
+		this->writeRow(x, y, color, 1);
+	};
+
+	bool ImageDisplayBuffer::IsFloat() {
+		return this->GetInactive()->format == PIXELFORMAT_UNCOMPRESSED_R32G32B32A32;
+	};
+
+	Color* ImageDisplayBuffer::Row(int y) {
+		Image* image = this->GetInactive();
+		if (image->format != PIXELFORMAT_UNCOMPRESSED_R8G8B8A8) {
+			return NULL;
+		}
+		return (Color*) image->data + (size_t) y * image->width;
+	};
+
+	Vector4* ImageDisplayBuffer::RowFloat(int y) {
+		Image* image = this->GetInactive();
+		if (image->format != PIXELFORMAT_UNCOMPRESSED_R32G32B32A32) {
+			return NULL;
+		}
+		return (Vector4*) image->data + (size_t) y * image->width;
+	};
+
+	void ImageDisplayBuffer::MarkDirty(int x, int y, int width, int height) {
+		Image* image = this->GetInactive();
+		int x0 = std::max(0, x), y0 = std::max(0, y);
+		int x1 = std::min(image->width, x + width), y1 = std::min(image->height, y + height);
+		if (x0 >= x1 || y0 >= y1) {
+			return;
+		}
+		// workers of one frame may share a cell, they all store the same stamp
+		std::atomic<unsigned int>* versions = this->cellVersions[this->writeIndex];
+		for (int cy = y0 / CELL_SIZE; cy <= (y1 - 1) / CELL_SIZE; cy++) {
+			for (int cx = x0 / CELL_SIZE; cx <= (x1 - 1) / CELL_SIZE; cx++) {
+				versions[cy * this->cellsX + cx].store(this->drawVersion, std::memory_order_relaxed);
+			}
+		}
 	};
 
+	void ImageDisplayBuffer::writeRow(int x, int y, const Color* pixels, int count) {
+		this->writeTile(x, y, count, 1, pixels, count);
+	};
+
+	void ImageDisplayBuffer::writeRow(int x, int y, const Vector4* pixels, int count) {
+		this->writeTile(x, y, count, 1, pixels, count);
+	};
+
+	void ImageDisplayBuffer::writeTile(int x, int y, int width, int height, const Color* pixels, int stride) {
+		Image* image = this->GetInactive();
+		int x0 = std::max(0, x), y0 = std::max(0, y);
+		int x1 = std::min(image->width, x + width), y1 = std::min(image->height, y + height);
+		if (x0 >= x1 || y0 >= y1) {
+			return;
+		}
+
+		bool isFloat = image->format == PIXELFORMAT_UNCOMPRESSED_R32G32B32A32;
+		for (int row = y0; row < y1; row++) {
+			const Color* source = pixels + (size_t) (row - y) * stride + (x0 - x);
+			if (isFloat) {
+				Vector4* target = this->RowFloat(row) + x0;
+				for (int i = 0; i < x1 - x0; i++) {
+					target[i] = toVector4(source[i]);
+				}
+			} else {
+				std::memcpy(this->Row(row) + x0, source, (size_t) (x1 - x0) * sizeof(Color));
+			}
+		}
+		this->MarkDirty(x0, y0, x1 - x0, y1 - y0);
+	};
+
+	void ImageDisplayBuffer::writeTile(int x, int y, int width, int height, const Vector4* pixels, int stride) {
+		Image* image = this->GetInactive();
+		int x0 = std::max(0, x), y0 = std::max(0, y);
+		int x1 = std::min(image->width, x + width), y1 = std::min(image->height, y + height);
+		if (x0 >= x1 || y0 >= y1) {
+			return;
+		}
+
+		bool isFloat = image->format == PIXELFORMAT_UNCOMPRESSED_R32G32B32A32;
+		for (int row = y0; row < y1; row++) {
+			const Vector4* source = pixels + (size_t) (row - y) * stride + (x0 - x);
+			if (isFloat) {
+				std::memcpy(this->RowFloat(row) + x0, source, (size_t) (x1 - x0) * sizeof(Vector4));
+			} else {
+				Color* target = this->Row(row) + x0;
+				for (int i = 0; i < x1 - x0; i++) {
+					target[i] = toColor(source[i]);
+				}
+			}
+		}
+		this->MarkDirty(x0, y0, x1 - x0, y1 - y0);
+	};
+
+	// Both copy image's pixels into the slot, converted to its format, and the caller keeps
+	// its image. An image of another size than the buffer goes through SetImage instead.
 	void ImageDisplayBuffer::SetActive(Image* image) { 
-		this->bufferState == 1 ? this->buffer1 = *image : this->buffer2 = *image;
+		if (!this->replaceSlot(this->presentIndex, image)) {
+			this->SetImage(image);
+			return;
+		}
+		std::fill(this->textureVersions.begin(), this->textureVersions.end(), ~0u); // resent on the next Present
 	};
 
 	void ImageDisplayBuffer::SetInactive(Image* image) { 
-		this->bufferState == 2 ? this->buffer1 = *image : this->buffer2 = *image;
+		if (!this->replaceSlot(this->writeIndex, image)) {
+			this->SetImage(image);
+			return;
+		}
+		this->MarkDirty(0, 0, image->width, image->height);
+	};
+
+	// false when slot is empty or a different size, the cell versions only fit the current one
+	bool ImageDisplayBuffer::replaceSlot(int slot, Image* image) {
+		Image* target = &this->buffers[slot];
+		if (target->data == NULL || image->width != target->width || image->height != target->height) {
+			return false;
+		}
+		Image copy = ImageCopy(*image);
+		if (copy.format != target->format) {
+			ImageFormat(&copy, target->format);
+		}
+		UnloadImage(*target);
+		*target = copy;
+		return true;
 	};
 
 	Image* ImageDisplayBuffer::GetActive() { 
-		return (this->bufferState == 1) ? &this->buffer1 : &this->buffer2;
+		return &this->buffers[this->presentIndex];
 	};
 
 	Image* ImageDisplayBuffer::GetInactive() { 
-		return (this->bufferState == 2) ? &this->buffer1 : &this->buffer2;
+		return &this->buffers[this->writeIndex];
+	};
+
+	// the slot handed back by Flip holds a frame two or three behind, cells that changed
+	// since are copied over from the frame just published so partial frames stay complete
+	void ImageDisplayBuffer::carryOver(int slot, int source) {
+		Image* target = &this->buffers[slot];
+		Image* from = &this->buffers[source];
+		int pixelSize = GetPixelDataSize(1, 1, target->format);
+		std::atomic<unsigned int>* versions = this->cellVersions[slot];
+		std::atomic<unsigned int>* sourceVersions = this->cellVersions[source];
+
+		for (int cy = 0; cy < this->cellsY; cy++) {
+			for (int cx = 0; cx < this->cellsX; cx++) {
+				int cell = cy * this->cellsX + cx;
+				unsigned int sourceVersion = sourceVersions[cell].load(std::memory_order_relaxed);
+				if (versions[cell].load(std::memory_order_relaxed) == sourceVersion) {
+					continue;
+				}
+				int x0 = cx * CELL_SIZE;
+				int width = std::min(CELL_SIZE, target->width - x0);
+				for (int y = cy * CELL_SIZE; y < std::min((cy + 1) * CELL_SIZE, target->height); y++) {
+					size_t offset = ((size_t) y * target->width + x0) * pixelSize;
+					std::memcpy((unsigned char*) target->data + offset, (unsigned char*) from->data + offset, (size_t) width * pixelSize);
+				}
+				versions[cell].store(sourceVersion, std::memory_order_relaxed);
+			}
+		}
 	};
 
 	void ImageDisplayBuffer::Flip() {
-		this->bufferState = (this->bufferState == 1) ? 2 : 1;
-		this->finished = false;
+		int published = this->writeIndex;
+		this->drawVersion += 1;
+
+		// release publishes the pixels written into the write image, acquire hands back a slot
+		// the display is done with
+		int previous = this->middleState.exchange(published | FRESH, std::memory_order_acq_rel);
+		this->writeIndex = previous & ~FRESH;
+
+		// the display only ever reads slots, so the published one is still safe to read
+		this->carryOver(this->writeIndex, published);
+	};
+
+	bool ImageDisplayBuffer::HasNewFrame() {
+		return (this->middleState.load(std::memory_order_relaxed) & FRESH) != 0;
+	};
+
+	// sends the cells of the present image whose stamp differs from the texture's, merging
+	// horizontal runs into one UpdateTextureRec each
+	void ImageDisplayBuffer::upload() {
+		Image* image = this->GetActive();
+		std::atomic<unsigned int>* versions = this->cellVersions[this->presentIndex];
+		int cellCount = this->cellsX * this->cellsY;
+
+		if (this->activeTexture.id == 0 || this->activeTexture.width != image->width || this->activeTexture.height != image->height || this->activeTexture.format != image->format) {
+			if (this->activeTexture.id != 0) {
+				UnloadTexture(this->activeTexture);
+			}
+			this->activeTexture = LoadTextureFromImage(*image);
+			for (int c = 0; c < cellCount; c++) {
+				this->textureVersions[c] = versions[c].load(std::memory_order_relaxed);
+			}
+			this->uploadedBytes = GetPixelDataSize(image->width, image->height, image->format);
+			return;
+		}
+
+		int dirtyCount = 0;
+		for (int c = 0; c < cellCount; c++) {
+			dirtyCount += versions[c].load(std::memory_order_relaxed) != this->textureVersions[c];
+		}
+		this->uploadedBytes = 0;
+		if (dirtyCount == 0) {
+			return;
+		}
+		if (dirtyCount == cellCount) {
+			UpdateTexture(this->activeTexture, image->data);
+			for (int c = 0; c < cellCount; c++) {
+				this->textureVersions[c] = versions[c].load(std::memory_order_relaxed);
+			}
+			this->uploadedBytes = GetPixelDataSize(image->width, image->height, image->format);
+			return;
+		}
+
+		int pixelSize = GetPixelDataSize(1, 1, image->format);
+		for (int cy = 0; cy < this->cellsY; cy++) {
+			int y0 = cy * CELL_SIZE;
+			int height = std::min(CELL_SIZE, image->height - y0);
+			int cx = 0;
+			while (cx < this->cellsX) {
+				int cell = cy * this->cellsX + cx;
+				if (versions[cell].load(std::memory_order_relaxed) == this->textureVersions[cell]) {
+					cx++;
+					continue;
+				}
+				int runStart = cx;
+				while (cx < this->cellsX && versions[cy * this->cellsX + cx].load(std::memory_order_relaxed) != this->textureVersions[cy * this->cellsX + cx]) {
+					this->textureVersions[cy * this->cellsX + cx] = versions[cy * this->cellsX + cx].load(std::memory_order_relaxed);
+					cx++;
+				}
+
+				// UpdateTextureRec wants the rectangle tightly packed
+				int x0 = runStart * CELL_SIZE;
+				int width = std::min(cx * CELL_SIZE, image->width) - x0;
+				size_t rowBytes = (size_t) width * pixelSize;
+				this->staging.resize(rowBytes * height);
+				for (int y = 0; y < height; y++) {
+					std::memcpy(this->staging.data() + y * rowBytes, (unsigned char*) image->data + ((size_t) (y0 + y) * image->width + x0) * pixelSize, rowBytes);
+				}
+				UpdateTextureRec(this->activeTexture, { (float) x0, (float) y0, (float) width, (float) height }, this->staging.data());
+				this->uploadedBytes += rowBytes * height;
+			}
+		}
+	};
 
-		Texture2D textured = LoadTextureFromImage( *new Image(*this->GetActive()) );
-		this->activeTexture = textured;
+	bool ImageDisplayBuffer::Acquire() {
+		if (!this->HasNewFrame()) {
+			return false;
+		}
+		int previous = this->middleState.exchange(this->presentIndex, std::memory_order_acq_rel);
+		this->presentIndex = previous & ~FRESH;
+		return true;
 	};
 
-	void ImageDisplayBuffer::SetState(bool finished) {
-		this->finished = finished;
+	bool ImageDisplayBuffer::Present() {
+		if (!this->Acquire()) {
+			return false;
+		}
+		// textures belong to the GL context, so uploads only ever happen on the display thread
+		this->upload();
+		return true;
 	};
 }
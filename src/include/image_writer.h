@@ -0,0 +1,316 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "raylib.h"
+#include "color.h"
+
+namespace tracer {
+
+	// Classes //
+	// Streams linear RGB rows to disk as they are finished, so only the rows in flight
+	// are ever in memory. Rows are handed over top to bottom in bands of any height.
+	class ImageWriter {
+		public:
+			int width;
+			int height;
+
+			ImageWriter();
+			virtual ~ImageWriter();
+
+			virtual bool open(const std::string& path, int width, int height) = 0;
+			virtual bool writeRows(int y, int count, const Vector3* pixels) = 0;
+			virtual bool close() = 0;
+			// what the writer itself holds once opened
+			virtual size_t memoryUsage();
+
+		protected:
+			FILE* file;
+	};
+
+	// binary P6, 8 bits per channel through the same gamma 2 curve as the preview
+	class PPMWriter : public ImageWriter {
+		public:
+			PPMWriter();
+			~PPMWriter();
+
+			bool open(const std::string& path, int width, int height);
+			bool writeRows(int y, int count, const Vector3* pixels);
+			bool close();
+			size_t memoryUsage();
+
+		private:
+			std::vector<unsigned char> row;
+	};
+
+	// little endian PF, full float radiance. PFM stores the bottom row first, the file
+	// size is known up front so each row is written straight to its place.
+	class PFMWriter : public ImageWriter {
+		public:
+			PFMWriter();
+			~PFMWriter();
+
+			bool open(const std::string& path, int width, int height);
+			bool writeRows(int y, int count, const Vector3* pixels);
+			bool close();
+
+		private:
+			long long dataOffset;
+	};
+
+	// Tiled float RGB: the header below, then tileSize x tileSize float tiles in row major
+	// tile order, edge tiles padded to full size so any tile sits at a computable offset.
+	//   char magic[8] = "TILEDF1\0"; int32 width, height, tileSize, channels
+	class TiledFloatWriter : public ImageWriter {
+		public:
+			static const int HEADER_SIZE = 24;
+			int tileSize;
+
+			TiledFloatWriter(int tileSize);
+			~TiledFloatWriter();
+
+			bool open(const std::string& path, int width, int height);
+			bool writeRows(int y, int count, const Vector3* pixels);
+			bool close();
+
+			// tiles may also be written directly and in any order
+			bool writeTile(int tileX, int tileY, const Vector3* pixels);
+			size_t memoryUsage();
+
+		private:
+			std::vector<Vector3> band;   // rows of the tile row being collected
+			int bandStart;
+			int bandRows;
+			bool flushBand();
+	};
+
+	// Methods //
+	// gigapixel files pass 2 GB, so seeks take 64 bit offsets everywhere
+	inline bool seekTo(FILE* file, long long offset) {
+#ifdef _WIN32
+		return _fseeki64(file, offset, SEEK_SET) == 0;
+#else
+		return fseeko(file, (off_t) offset, SEEK_SET) == 0;
+#endif
+	}
+
+	// picks the writer from the extension: .ppm, .pfm or .tlf, NULL for anything else
+	ImageWriter* createImageWriter(const std::string& path);
+
+	// ImageWriter //
+	ImageWriter::ImageWriter() {
+		this->width = 0;
+		this->height = 0;
+		this->file = NULL;
+	};
+
+	ImageWriter::~ImageWriter() {
+		if (this->file != NULL) {
+			fclose(this->file);
+		}
+	};
+
+	size_t ImageWriter::memoryUsage() {
+		return 0;
+	};
+
+	// PPMWriter //
+	PPMWriter::PPMWriter() {
+
+	};
+
+	PPMWriter::~PPMWriter() {
+
+	};
+
+	bool PPMWriter::open(const std::string& path, int width, int height) {
+		this->width = width;
+		this->height = height;
+		this->file = fopen(path.c_str(), "wb");
+		if (this->file == NULL) {
+			return false;
+		}
+		this->row.resize((size_t) width * 3);
+		return fprintf(this->file, "P6\n%d %d\n255\n", width, height) > 0;
+	};
+
+	bool PPMWriter::writeRows(int y, int count, const Vector3* pixels) {
+		// sRGB encoded 64 pixels at a time through the span conversion, like the display
+		Color3::Color3 encoded[64];
+		for (int r = 0; r < count; r++) {
+			const Vector3* source = pixels + (size_t) r * this->width;
+			for (int x = 0; x < this->width; x += 64) {
+				int n = std::min(64, this->width - x);
+				std::memcpy((void*) encoded, source + x, (size_t) n * sizeof(Vector3));
+				Color3::toSRGB(encoded, encoded, (size_t) n);
+				const float* channels = (const float*) encoded;
+				for (int i = 0; i < n * 3; i++) {
+					this->row[x * 3 + i] = (unsigned char) Color3::toByte(channels[i]);
+				}
+			}
+			if (fwrite(this->row.data(), 1, this->row.size(), this->file) != this->row.size()) {
+				return false;
+			}
+		}
+		return true;
+	};
+
+	bool PPMWriter::close() {
+		bool ok = this->file != NULL && fclose(this->file) == 0;
+		this->file = NULL;
+		return ok;
+	};
+
+	size_t PPMWriter::memoryUsage() {
+		return this->row.size();
+	};
+
+	// PFMWriter //
+	PFMWriter::PFMWriter() {
+		this->dataOffset = 0;
+	};
+
+	PFMWriter::~PFMWriter() {
+
+	};
+
+	bool PFMWriter::open(const std::string& path, int width, int height) {
+		this->width = width;
+		this->height = height;
+		this->file = fopen(path.c_str(), "wb");
+		if (this->file == NULL) {
+			return false;
+		}
+		int headerSize = fprintf(this->file, "PF\n%d %d\n-1.0\n", width, height);
+		this->dataOffset = headerSize;
+		return headerSize > 0;
+	};
+
+	bool PFMWriter::writeRows(int y, int count, const Vector3* pixels) {
+		size_t rowBytes = (size_t) this->width * sizeof(Vector3);
+		for (int r = 0; r < count; r++) {
+			long long offset = this->dataOffset + (long long) (this->height - 1 - (y + r)) * (long long) rowBytes;
+			if (!seekTo(this->file, offset)) {
+				return false;
+			}
+			if (fwrite(pixels + (size_t) r * this->width, 1, rowBytes, this->file) != rowBytes) {
+				return false;
+			}
+		}
+		return true;
+	};
+
+	bool PFMWriter::close() {
+		bool ok = this->file != NULL && fclose(this->file) == 0;
+		this->file = NULL;
+		return ok;
+	};
+
+	// TiledFloatWriter //
+	TiledFloatWriter::TiledFloatWriter(int tileSize) {
+		this->tileSize = tileSize;
+		this->bandStart = 0;
+		this->bandRows = 0;
+	};
+
+	TiledFloatWriter::~TiledFloatWriter() {
+
+	};
+
+	bool TiledFloatWriter::open(const std::string& path, int width, int height) {
+		this->width = width;
+		this->height = height;
+		this->file = fopen(path.c_str(), "wb");
+		if (this->file == NULL) {
+			return false;
+		}
+		char header[HEADER_SIZE] = "TILEDF1";
+		int fields[4] = { width, height, this->tileSize, 3 };
+		std::memcpy(header + 8, fields, sizeof(fields));
+		this->band.assign((size_t) width * this->tileSize, { 0.0f, 0.0f, 0.0f });
+		this->bandStart = 0;
+		this->bandRows = 0;
+		return fwrite(header, 1, HEADER_SIZE, this->file) == HEADER_SIZE;
+	};
+
+	bool TiledFloatWriter::writeTile(int tileX, int tileY, const Vector3* pixels) {
+		int tilesX = (this->width + this->tileSize - 1) / this->tileSize;
+		size_t tileBytes = (size_t) this->tileSize * this->tileSize * sizeof(Vector3);
+		long long offset = HEADER_SIZE + ((long long) tileY * tilesX + tileX) * (long long) tileBytes;
+		if (!seekTo(this->file, offset)) {
+			return false;
+		}
+		return fwrite(pixels, 1, tileBytes, this->file) == tileBytes;
+	};
+
+	bool TiledFloatWriter::flushBand() {
+		int tilesX = (this->width + this->tileSize - 1) / this->tileSize;
+		std::vector<Vector3> tile((size_t) this->tileSize * this->tileSize, { 0.0f, 0.0f, 0.0f });
+		for (int tx = 0; tx < tilesX; tx++) {
+			int x0 = tx * this->tileSize;
+			int columns = std::min(this->tileSize, this->width - x0);
+			for (int r = 0; r < this->tileSize; r++) {
+				Vector3* target = &tile[(size_t) r * this->tileSize];
+				if (r < this->bandRows) {
+					std::memcpy(target, &this->band[(size_t) r * this->width + x0], columns * sizeof(Vector3));
+					std::fill(target + columns, target + this->tileSize, Vector3{ 0.0f, 0.0f, 0.0f });
+				} else {
+					std::fill(target, target + this->tileSize, Vector3{ 0.0f, 0.0f, 0.0f });
+				}
+			}
+			if (!this->writeTile(tx, this->bandStart / this->tileSize, tile.data())) {
+				return false;
+			}
+		}
+		this->bandStart += this->tileSize;
+		this->bandRows = 0;
+		return true;
+	};
+
+	// rows are collected until a whole tile row is there, then written out as tiles
+	bool TiledFloatWriter::writeRows(int y, int count, const Vector3* pixels) {
+		for (int r = 0; r < count; r++) {
+			std::memcpy(&this->band[(size_t) this->bandRows * this->width], pixels + (size_t) r * this->width, this->width * sizeof(Vector3));
+			this->bandRows += 1;
+			if (this->bandRows == this->tileSize || this->bandStart + this->bandRows == this->height) {
+				if (!this->flushBand()) {
+					return false;
+				}
+			}
+		}
+		return true;
+	};
+
+	bool TiledFloatWriter::close() {
+		bool ok = this->file != NULL && fclose(this->file) == 0;
+		this->file = NULL;
+		return ok;
+	};
+
+	// the collected band plus the tile flushBand assembles
+	size_t TiledFloatWriter::memoryUsage() {
+		return (this->band.size() + (size_t) this->tileSize * this->tileSize) * sizeof(Vector3);
+	};
+
+	ImageWriter* createImageWriter(const std::string& path) {
+		size_t dot = path.find_last_of('.');
+		std::string extension = dot == std::string::npos ? "" : path.substr(dot + 1);
+		std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+		if (extension == "ppm") {
+			return new PPMWriter();
+		}
+		if (extension == "pfm") {
+			return new PFMWriter();
+		}
+		if (extension == "tlf") {
+			return new TiledFloatWriter(64);
+		}
+		return NULL;
+	}
+
+};
@@ -0,0 +1,322 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace jobs {
+
+	class Counter;
+
+	// Structs //
+	struct Job {
+		std::function<void()> fn;
+		Counter* signal;
+	};
+
+	// Classes //
+	// Number of unfinished jobs signalling it. Jobs queued with runAfter are held here
+	// until it drops to zero.
+	class Counter {
+		public:
+			std::atomic<int> value;
+			std::mutex lock;
+			std::vector<Job*> continuations;
+
+			Counter();
+			~Counter();
+
+			bool done();
+	};
+
+	// One deque per worker: the owner pushes and pops at the back (LIFO, cache warm),
+	// thieves take from the front (FIFO, the largest and oldest pieces of work).
+	class WorkQueue {
+		public:
+			std::mutex lock;
+			std::deque<Job*> jobs;
+
+			WorkQueue();
+			~WorkQueue();
+
+			void push(Job* job);
+			Job* pop();
+			Job* steal();
+	};
+
+	class JobSystem {
+		public:
+			JobSystem(int workerCount);
+			~JobSystem();
+
+			int workerCount();
+			int currentWorker();  // 0 .. workerCount - 1 on workers, workerCount on any other thread
+
+			void run(std::function<void()> fn, Counter* signal);
+			void runAfter(Counter* dependency, std::function<void()> fn, Counter* signal);
+			void wait(Counter* counter);
+
+			// fn(start, stop) over [begin, end) in pieces of grain, the caller helps until all are done
+			template<typename Fn>
+			void parallelFor(int begin, int end, int grain, Fn fn);
+
+		private:
+			int workers;
+			std::vector<WorkQueue*> queues;   // workers first, the shared external queue last
+			std::vector<std::thread> threads;
+			std::atomic<bool> running;
+			std::atomic<int> queued;
+			std::mutex sleepLock;
+			std::condition_variable wake;
+
+			void enqueue(Job* job);
+			Job* findJob(int index);
+			bool executeOne(int index);
+			void finish(Job* job);
+			void workerLoop(int index);
+	};
+
+	// the process wide pool, created on first use with one worker per core minus the
+	// thread that waits on it. initShared picks the size instead, false once it exists.
+	JobSystem* shared();
+	bool initShared(int workerCount);
+
+	// Thread Identity //
+	static thread_local JobSystem* currentSystem = NULL;
+	static thread_local int currentIndex = -1;
+
+	// Counter //
+	Counter::Counter() {
+		this->value.store(0);
+	};
+
+	Counter::~Counter() {
+
+	};
+
+	bool Counter::done() {
+		return this->value.load(std::memory_order_acquire) == 0;
+	};
+
+	// WorkQueue //
+	WorkQueue::WorkQueue() {
+
+	};
+
+	WorkQueue::~WorkQueue() {
+
+	};
+
+	void WorkQueue::push(Job* job) {
+		std::lock_guard<std::mutex> guard(this->lock);
+		this->jobs.push_back(job);
+	};
+
+	Job* WorkQueue::pop() {
+		std::lock_guard<std::mutex> guard(this->lock);
+		if (this->jobs.empty()) {
+			return NULL;
+		}
+		Job* job = this->jobs.back();
+		this->jobs.pop_back();
+		return job;
+	};
+
+	Job* WorkQueue::steal() {
+		std::lock_guard<std::mutex> guard(this->lock);
+		if (this->jobs.empty()) {
+			return NULL;
+		}
+		Job* job = this->jobs.front();
+		this->jobs.pop_front();
+		return job;
+	};
+
+	// JobSystem //
+	JobSystem::JobSystem(int workerCount) {
+		this->workers = std::max(0, workerCount);
+		this->running.store(true);
+		this->queued.store(0);
+		for (int i = 0; i <= this->workers; i++) {
+			this->queues.push_back(new WorkQueue());
+		}
+		for (int i = 0; i < this->workers; i++) {
+			this->threads.push_back(std::thread(&JobSystem::workerLoop, this, i));
+		}
+	};
+
+	JobSystem::~JobSystem() {
+		{
+			std::lock_guard<std::mutex> guard(this->sleepLock);
+			this->running.store(false);
+		}
+		this->wake.notify_all();
+		for (std::thread& thread : this->threads) {
+			thread.join();
+		}
+		for (WorkQueue* queue : this->queues) {
+			delete(queue);
+		}
+	};
+
+	int JobSystem::workerCount() {
+		return this->workers;
+	};
+
+	int JobSystem::currentWorker() {
+		return (currentSystem == this) ? currentIndex : this->workers;
+	};
+
+	void JobSystem::enqueue(Job* job) {
+		this->queues[this->currentWorker()]->push(job);
+		// counted under the sleep lock, a worker between checking queued and blocking
+		// would otherwise miss the notify and sleep with work pending
+		{
+			std::lock_guard<std::mutex> guard(this->sleepLock);
+			this->queued.fetch_add(1, std::memory_order_release);
+		}
+		this->wake.notify_one();
+	};
+
+	void JobSystem::run(std::function<void()> fn, Counter* signal) {
+		if (signal != NULL) {
+			signal->value.fetch_add(1, std::memory_order_relaxed);
+		}
+		this->enqueue(new Job{ fn, signal });
+	};
+
+	void JobSystem::runAfter(Counter* dependency, std::function<void()> fn, Counter* signal) {
+		if (signal != NULL) {
+			signal->value.fetch_add(1, std::memory_order_relaxed);
+		}
+		Job* job = new Job{ fn, signal };
+
+		std::unique_lock<std::mutex> guard(dependency->lock);
+		if (dependency->done()) {
+			guard.unlock();
+			this->enqueue(job);
+		} else {
+			dependency->continuations.push_back(job);
+		}
+	};
+
+	Job* JobSystem::findJob(int index) {
+		Job* job = this->queues[index]->pop();
+		if (job != NULL) {
+			return job;
+		}
+		int count = (int) this->queues.size();
+		for (int i = 1; i < count; i++) {
+			job = this->queues[(index + i) % count]->steal();
+			if (job != NULL) {
+				return job;
+			}
+		}
+		return NULL;
+	};
+
+	bool JobSystem::executeOne(int index) {
+		Job* job = this->findJob(index);
+		if (job == NULL) {
+			return false;
+		}
+		this->queued.fetch_sub(1, std::memory_order_relaxed);
+		job->fn();
+		this->finish(job);
+		return true;
+	};
+
+	void JobSystem::finish(Job* job) {
+		Counter* signal = job->signal;
+		delete(job);
+		if (signal == NULL) {
+			return;
+		}
+
+		// take the lock before publishing zero so runAfter can not slip a job in between
+		std::vector<Job*> ready;
+		{
+			std::lock_guard<std::mutex> guard(signal->lock);
+			if (signal->value.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+				ready.swap(signal->continuations);
+			}
+		}
+		for (Job* next : ready) {
+			this->enqueue(next);
+		}
+	};
+
+	void JobSystem::wait(Counter* counter) {
+		// the waiting thread runs jobs instead of blocking, that is how the main thread participates
+		int index = this->currentWorker();
+		while (!counter->done()) {
+			if (!this->executeOne(index)) {
+				std::this_thread::yield();
+			}
+		}
+		// finish publishes zero while holding the lock, once it is free again the counter
+		// is no longer touched and may go out of scope
+		std::lock_guard<std::mutex> guard(counter->lock);
+	};
+
+	void JobSystem::workerLoop(int index) {
+		currentSystem = this;
+		currentIndex = index;
+
+		while (this->running.load()) {
+			if (this->executeOne(index)) {
+				continue;
+			}
+			std::unique_lock<std::mutex> guard(this->sleepLock);
+			this->wake.wait(guard, [this]() {
+				return this->queued.load() > 0 || !this->running.load();
+			});
+		}
+	};
+
+	template<typename Fn>
+	void JobSystem::parallelFor(int begin, int end, int grain, Fn fn) {
+		if (end <= begin) {
+			return;
+		}
+		grain = std::max(1, grain);
+		if (end - begin <= grain) {
+			fn(begin, end);
+			return;
+		}
+
+		Counter counter;
+		for (int start = begin; start < end; start += grain) {
+			int stop = std::min(end, start + grain);
+			this->run([&fn, start, stop]() { fn(start, stop); }, &counter);
+		}
+		this->wait(&counter);
+	};
+
+	static std::mutex sharedLock;
+	static std::atomic<JobSystem*> sharedSystem(NULL);
+
+	bool initShared(int workerCount) {
+		std::lock_guard<std::mutex> guard(sharedLock);
+		if (sharedSystem.load() != NULL) {
+			return false;
+		}
+		sharedSystem.store(new JobSystem(workerCount));
+		return true;
+	}
+
+	JobSystem* shared() {
+		JobSystem* system = sharedSystem.load(std::memory_order_acquire);
+		if (system == NULL) {
+			initShared(std::max(1, (int) std::thread::hardware_concurrency() - 1));
+			system = sharedSystem.load(std::memory_order_acquire);
+		}
+		return system;
+	}
+
+};
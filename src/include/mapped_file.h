@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace tracer {
+
+	// Classes //
+	// A file mapped read/write into memory, written back to disk by flush. The platform
+	// code (mmap or CreateFileMapping) lives in mapped_file.cpp so windows.h stays out of
+	// the headers, where it clashes with raylib.
+	class MappedFile {
+		public:
+			MappedFile();
+			~MappedFile();
+
+			// maps path at exactly size bytes, creating or resizing the file as needed.
+			// existing tells whether the file was already there at that size.
+			bool open(const std::string& path, size_t size, bool* existing);
+			void close();
+			// writes the range back and waits for the disk, false on an I/O error
+			bool flush(size_t offset, size_t length);
+
+			unsigned char* data();
+			size_t size();
+			bool isOpen();
+
+		private:
+			unsigned char* base;
+			size_t length;
+			intptr_t file;      // descriptor or HANDLE
+			intptr_t mapping;   // HANDLE of the mapping object, unused with mmap
+	};
+
+};
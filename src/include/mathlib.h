@@ -3,24 +3,43 @@
 #include <string>
 #include <cmath>
 #include <algorithm>
-#include <random>
 #include <ctime>
 #include "stringlib.h"
+#include "random.h"
 
 namespace mathlib {
 
 	// Extra Methods //
+	// in [min, max), from this thread's own generator so callers never share state
 	int randomInt(int min, int max) {
-		static std::default_random_engine e;
-		static std::uniform_real_distribution<> dis(0, 1); // rage 0 - 1
-		float v = min + ((max - min) * dis(e));
-		return std::floor(v);
+		if (max <= min) {
+			return min;
+		}
+		return min + (int) threadRandom().below((uint32_t) (max - min));
+	}
+
+	// Stateless random numbers for rendering: the value is a function of its key alone,
+	// so it does not matter which thread, tile order or machine asks for it. The seed picks
+	// one of many equally good sequences; 0 is the default one and mixes nothing into the key.
+	inline unsigned int sampleHash(unsigned int x, unsigned int y, unsigned int sample, unsigned int dimension, unsigned int seed) {
+		unsigned int h = x * 0x8da6b343u ^ y * 0xd8163841u ^ sample * 0xcb1ab31fu ^ dimension * 0x165667b1u ^ seed * 0x9e3779b9u;
+		h ^= h >> 16;
+		h *= 0x7feb352du;
+		h ^= h >> 15;
+		h *= 0x846ca68bu;
+		h ^= h >> 16;
+		return h;
+	}
+
+	// in [0, 1), 24 bits so every value is exact in a float
+	inline float sampleFloat(unsigned int x, unsigned int y, unsigned int sample, unsigned int dimension, unsigned int seed) {
+		return toUnitFloat(sampleHash(x, y, sample, dimension, seed));
 	}
 
 	std::string randomString(int len) {
 		std::string str;
 		for (int i = 0; i < len; i++) {
-			char ch = 'A' + rand() % 26;
+			char ch = 'A' + threadRandom().below(26);
 			str.push_back(ch);
 		}
 		return str;
@@ -0,0 +1,471 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "raylib.h"
+#include "geometry.h"
+
+namespace geometry {
+
+	// Structs //
+	// full precision vertex, 32 bytes
+	struct Vertex {
+		Vector3 position;
+		Vector3 normal;
+		Vector2 uv;
+	};
+
+	// compressed vertex, 16 bytes
+	// position is 16 bits per axis relative to the mesh bounds, normal is octahedral
+	// snorm16x2 and uv is half precision
+	struct QuantizedVertex {
+		uint32_t normal;
+		uint16_t px, py, pz;
+		uint16_t u, v;
+		uint16_t padding;
+	};
+
+	static_assert(sizeof(Vertex) == 32 && sizeof(QuantizedVertex) == 16, "quantized vertices are half the size of full ones");
+
+	// Encoding //
+	inline uint16_t floatToHalf(float value) {
+		uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+
+		uint32_t sign = (bits >> 16) & 0x8000;
+		int32_t exponent = (int32_t) ((bits >> 23) & 0xFF) - 127 + 15;
+		uint32_t mantissa = bits & 0x007FFFFF;
+
+		if (((bits >> 23) & 0xFF) == 0xFF) {
+			// inf / nan
+			return (uint16_t) (sign | 0x7C00 | (mantissa ? 0x200 : 0));
+		}
+		if (exponent >= 31) {
+			return (uint16_t) (sign | 0x7C00);
+		}
+		if (exponent <= 0) {
+			if (exponent < -10) {
+				return (uint16_t) sign;
+			}
+			// denormal, round to nearest
+			mantissa |= 0x00800000;
+			uint32_t shift = (uint32_t) (14 - exponent);
+			uint32_t half = mantissa >> shift;
+			if ((mantissa >> (shift - 1)) & 1) {
+				half += 1;
+			}
+			return (uint16_t) (sign | half);
+		}
+
+		uint32_t half = sign | ((uint32_t) exponent << 10) | (mantissa >> 13);
+		if (mantissa & 0x00001000) {
+			half += 1; // round to nearest, carries into the exponent correctly
+		}
+		return (uint16_t) half;
+	}
+
+	inline float halfToFloat(uint16_t half) {
+		uint32_t sign = (uint32_t) (half & 0x8000) << 16;
+		uint32_t exponent = (half >> 10) & 0x1F;
+		uint32_t mantissa = half & 0x03FF;
+		uint32_t bits;
+
+		if (exponent == 0) {
+			if (mantissa == 0) {
+				bits = sign;
+			} else {
+				// renormalise the denormal
+				exponent = 127 - 15 + 1;
+				while ((mantissa & 0x0400) == 0) {
+					mantissa <<= 1;
+					exponent -= 1;
+				}
+				mantissa &= 0x03FF;
+				bits = sign | (exponent << 23) | (mantissa << 13);
+			}
+		} else if (exponent == 31) {
+			bits = sign | 0x7F800000 | (mantissa << 13);
+		} else {
+			bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+		}
+
+		float value;
+		std::memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+	inline int16_t toSnorm16(float v) {
+		v = std::max(-1.0f, std::min(1.0f, v));
+		return (int16_t) std::lround(v * 32767.0f);
+	}
+
+	inline uint32_t encodeOctahedral(Vector3 n) {
+		float l1 = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+		if (l1 == 0.0f) {
+			return 0;
+		}
+		float x = n.x / l1;
+		float y = n.y / l1;
+		if (n.z < 0.0f) {
+			float ox = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+			float oy = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+			x = ox;
+			y = oy;
+		}
+		uint16_t qx = (uint16_t) toSnorm16(x);
+		uint16_t qy = (uint16_t) toSnorm16(y);
+		return (uint32_t) qx | ((uint32_t) qy << 16);
+	}
+
+	inline Vector3 decodeOctahedral(uint32_t encoded) {
+		float x = (float) (int16_t) (encoded & 0xFFFF) / 32767.0f;
+		float y = (float) (int16_t) (encoded >> 16) / 32767.0f;
+		float z = 1.0f - std::fabs(x) - std::fabs(y);
+		if (z < 0.0f) {
+			float ox = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+			float oy = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+			x = ox;
+			y = oy;
+		}
+		return normalize(vec3(x, y, z));
+	}
+
+	// Classes //
+	class TriangleMesh {
+		public:
+			std::vector<Vertex> vertices;
+			std::vector<unsigned int> indices;
+			BoundingBox box;
+
+			TriangleMesh();
+			TriangleMesh(Mesh* mesh);
+			~TriangleMesh();
+
+			void toDefault();
+			void load(Mesh* mesh);
+
+			int triangleCount();
+			void trianglePositions(int tri, Vector3* p0, Vector3* p1, Vector3* p2);
+			BoundingBox bounds();
+			BoundingBox triangleBounds(int tri);
+			size_t memoryUsage();
+
+			bool intersectTriangle(int tri, const Ray& ray, float tMax, HitRecord* hit);
+			bool intersect(const Ray& ray, float tMax, HitRecord* hit);
+			void fillSurface(HitRecord* hit);
+	};
+
+	class QuantizedMesh {
+		public:
+			std::vector<QuantizedVertex> vertices;
+			std::vector<unsigned int> indices;
+			BoundingBox box;
+			Vector3 origin;      // decode: position = origin + q * scale
+			Vector3 scale;
+
+			QuantizedMesh();
+			QuantizedMesh(Mesh* mesh);
+			QuantizedMesh(TriangleMesh* source);
+			~QuantizedMesh();
+
+			void toDefault();
+			void load(TriangleMesh* source);
+
+			Vector3 decodePosition(const QuantizedVertex& qv);
+			Vector3 decodeNormal(const QuantizedVertex& qv);
+			Vector2 decodeUV(const QuantizedVertex& qv);
+
+			int triangleCount();
+			void trianglePositions(int tri, Vector3* p0, Vector3* p1, Vector3* p2);
+			BoundingBox bounds();
+			BoundingBox triangleBounds(int tri);
+			size_t memoryUsage();
+
+			bool intersectTriangle(int tri, const Ray& ray, float tMax, HitRecord* hit);
+			bool intersect(const Ray& ray, float tMax, HitRecord* hit);
+			void fillSurface(HitRecord* hit);
+	};
+
+	// TriangleMesh //
+	TriangleMesh::TriangleMesh() {
+		this->toDefault();
+	};
+
+	TriangleMesh::TriangleMesh(Mesh* mesh) {
+		this->toDefault();
+		this->load(mesh);
+	};
+
+	TriangleMesh::~TriangleMesh() {
+
+	};
+
+	void TriangleMesh::toDefault() {
+		this->vertices.clear();
+		this->indices.clear();
+		this->box = emptyBounds();
+	};
+
+	void TriangleMesh::load(Mesh* mesh) {
+		this->toDefault();
+
+		// prefer the animated pose when raylib has one
+		float* positions = mesh->animVertices != NULL ? mesh->animVertices : mesh->vertices;
+		float* normals = mesh->animNormals != NULL ? mesh->animNormals : mesh->normals;
+
+		this->vertices.resize(mesh->vertexCount);
+		for (int i = 0; i < mesh->vertexCount; i++) {
+			Vertex* vert = &this->vertices[i];
+			vert->position = vec3(positions[i * 3], positions[i * 3 + 1], positions[i * 3 + 2]);
+			vert->normal = (normals != NULL) ? vec3(normals[i * 3], normals[i * 3 + 1], normals[i * 3 + 2]) : vec3(0, 0, 0);
+			vert->uv = (mesh->texcoords != NULL) ? Vector2{ mesh->texcoords[i * 2], mesh->texcoords[i * 2 + 1] } : Vector2{ 0, 0 };
+			grow(&this->box, vert->position);
+		}
+
+		// raylib meshes are either indexed or a flat triangle list
+		this->indices.resize(mesh->triangleCount * 3);
+		for (int i = 0; i < mesh->triangleCount * 3; i++) {
+			this->indices[i] = (mesh->indices != NULL) ? (unsigned int) mesh->indices[i] : (unsigned int) i;
+		}
+
+		if (normals == NULL) {
+			// accumulate area weighted face normals so shading always has something to work with
+			for (int tri = 0; tri < this->triangleCount(); tri++) {
+				Vector3 p0, p1, p2;
+				this->trianglePositions(tri, &p0, &p1, &p2);
+				Vector3 n = cross(sub(p1, p0), sub(p2, p0));
+				for (int k = 0; k < 3; k++) {
+					Vertex* vert = &this->vertices[this->indices[tri * 3 + k]];
+					vert->normal = add(vert->normal, n);
+				}
+			}
+			for (Vertex& vert : this->vertices) {
+				vert.normal = normalize(vert.normal);
+			}
+		}
+	};
+
+	int TriangleMesh::triangleCount() {
+		return (int) (this->indices.size() / 3);
+	};
+
+	void TriangleMesh::trianglePositions(int tri, Vector3* p0, Vector3* p1, Vector3* p2) {
+		const unsigned int* idx = &this->indices[tri * 3];
+		*p0 = this->vertices[idx[0]].position;
+		*p1 = this->vertices[idx[1]].position;
+		*p2 = this->vertices[idx[2]].position;
+	};
+
+	BoundingBox TriangleMesh::bounds() {
+		return this->box;
+	};
+
+	BoundingBox TriangleMesh::triangleBounds(int tri) {
+		Vector3 p0, p1, p2;
+		this->trianglePositions(tri, &p0, &p1, &p2);
+		BoundingBox b = { p0, p0 };
+		grow(&b, p1);
+		grow(&b, p2);
+		return b;
+	};
+
+	size_t TriangleMesh::memoryUsage() {
+		return this->vertices.size() * sizeof(Vertex) + this->indices.size() * sizeof(unsigned int);
+	};
+
+	bool TriangleMesh::intersectTriangle(int tri, const Ray& ray, float tMax, HitRecord* hit) {
+		Vector3 p0, p1, p2;
+		float t, u, v;
+		this->trianglePositions(tri, &p0, &p1, &p2);
+		if (!geometry::intersectTriangle(ray, p0, p1, p2, tMax, &t, &u, &v)) {
+			return false;
+		}
+		hit->hit = true;
+		hit->distance = t;
+		hit->u = u;
+		hit->v = v;
+		hit->primitiveId = tri;
+		return true;
+	};
+
+	bool TriangleMesh::intersect(const Ray& ray, float tMax, HitRecord* hit) {
+		bool found = false;
+		for (int tri = 0; tri < this->triangleCount(); tri++) {
+			if (this->intersectTriangle(tri, ray, tMax, hit)) {
+				tMax = hit->distance;
+				found = true;
+			}
+		}
+		return found;
+	};
+
+	void TriangleMesh::fillSurface(HitRecord* hit) {
+		const unsigned int* idx = &this->indices[hit->primitiveId * 3];
+		const Vertex& a = this->vertices[idx[0]];
+		const Vertex& b = this->vertices[idx[1]];
+		const Vertex& c = this->vertices[idx[2]];
+		float w = 1.0f - hit->u - hit->v;
+
+		hit->normal = normalize(add(add(mul(a.normal, w), mul(b.normal, hit->u)), mul(c.normal, hit->v)));
+		hit->uv = {
+			a.uv.x * w + b.uv.x * hit->u + c.uv.x * hit->v,
+			a.uv.y * w + b.uv.y * hit->u + c.uv.y * hit->v
+		};
+	};
+
+	// QuantizedMesh //
+	QuantizedMesh::QuantizedMesh() {
+		this->toDefault();
+	};
+
+	QuantizedMesh::QuantizedMesh(Mesh* mesh) {
+		this->toDefault();
+		TriangleMesh source(mesh);
+		this->load(&source);
+	};
+
+	QuantizedMesh::QuantizedMesh(TriangleMesh* source) {
+		this->toDefault();
+		this->load(source);
+	};
+
+	QuantizedMesh::~QuantizedMesh() {
+
+	};
+
+	void QuantizedMesh::toDefault() {
+		this->vertices.clear();
+		this->indices.clear();
+		this->box = emptyBounds();
+		this->origin = vec3(0, 0, 0);
+		this->scale = vec3(0, 0, 0);
+	};
+
+	void QuantizedMesh::load(TriangleMesh* source) {
+		this->toDefault();
+		this->indices = source->indices;
+
+		BoundingBox sourceBox = source->bounds();
+		Vector3 extent = sub(sourceBox.max, sourceBox.min);
+		this->origin = sourceBox.min;
+		this->scale = mul(extent, 1.0f / 65535.0f);
+
+		Vector3 invScale = {
+			extent.x > 0 ? 65535.0f / extent.x : 0.0f,
+			extent.y > 0 ? 65535.0f / extent.y : 0.0f,
+			extent.z > 0 ? 65535.0f / extent.z : 0.0f
+		};
+
+		this->vertices.resize(source->vertices.size());
+		for (size_t i = 0; i < source->vertices.size(); i++) {
+			const Vertex& src = source->vertices[i];
+			QuantizedVertex* qv = &this->vertices[i];
+			Vector3 rel = mul(sub(src.position, this->origin), invScale);
+			qv->px = (uint16_t) std::min(65535L, std::max(0L, std::lround(rel.x)));
+			qv->py = (uint16_t) std::min(65535L, std::max(0L, std::lround(rel.y)));
+			qv->pz = (uint16_t) std::min(65535L, std::max(0L, std::lround(rel.z)));
+			qv->normal = encodeOctahedral(src.normal);
+			qv->u = floatToHalf(src.uv.x);
+			qv->v = floatToHalf(src.uv.y);
+			qv->padding = 0;
+		}
+
+		// bounds of the decoded positions, so the acceleration structure encloses what we intersect
+		for (const QuantizedVertex& qv : this->vertices) {
+			grow(&this->box, this->decodePosition(qv));
+		}
+	};
+
+	Vector3 QuantizedMesh::decodePosition(const QuantizedVertex& qv) {
+		return {
+			this->origin.x + (float) qv.px * this->scale.x,
+			this->origin.y + (float) qv.py * this->scale.y,
+			this->origin.z + (float) qv.pz * this->scale.z
+		};
+	};
+
+	Vector3 QuantizedMesh::decodeNormal(const QuantizedVertex& qv) {
+		return decodeOctahedral(qv.normal);
+	};
+
+	Vector2 QuantizedMesh::decodeUV(const QuantizedVertex& qv) {
+		return { halfToFloat(qv.u), halfToFloat(qv.v) };
+	};
+
+	int QuantizedMesh::triangleCount() {
+		return (int) (this->indices.size() / 3);
+	};
+
+	void QuantizedMesh::trianglePositions(int tri, Vector3* p0, Vector3* p1, Vector3* p2) {
+		const unsigned int* idx = &this->indices[tri * 3];
+		*p0 = this->decodePosition(this->vertices[idx[0]]);
+		*p1 = this->decodePosition(this->vertices[idx[1]]);
+		*p2 = this->decodePosition(this->vertices[idx[2]]);
+	};
+
+	BoundingBox QuantizedMesh::bounds() {
+		return this->box;
+	};
+
+	BoundingBox QuantizedMesh::triangleBounds(int tri) {
+		Vector3 p0, p1, p2;
+		this->trianglePositions(tri, &p0, &p1, &p2);
+		BoundingBox b = { p0, p0 };
+		grow(&b, p1);
+		grow(&b, p2);
+		return b;
+	};
+
+	size_t QuantizedMesh::memoryUsage() {
+		return this->vertices.size() * sizeof(QuantizedVertex) + this->indices.size() * sizeof(unsigned int);
+	};
+
+	bool QuantizedMesh::intersectTriangle(int tri, const Ray& ray, float tMax, HitRecord* hit) {
+		Vector3 p0, p1, p2;
+		float t, u, v;
+		this->trianglePositions(tri, &p0, &p1, &p2);
+		if (!geometry::intersectTriangle(ray, p0, p1, p2, tMax, &t, &u, &v)) {
+			return false;
+		}
+		hit->hit = true;
+		hit->distance = t;
+		hit->u = u;
+		hit->v = v;
+		hit->primitiveId = tri;
+		return true;
+	};
+
+	bool QuantizedMesh::intersect(const Ray& ray, float tMax, HitRecord* hit) {
+		bool found = false;
+		for (int tri = 0; tri < this->triangleCount(); tri++) {
+			if (this->intersectTriangle(tri, ray, tMax, hit)) {
+				tMax = hit->distance;
+				found = true;
+			}
+		}
+		return found;
+	};
+
+	void QuantizedMesh::fillSurface(HitRecord* hit) {
+		const unsigned int* idx = &this->indices[hit->primitiveId * 3];
+		const QuantizedVertex& a = this->vertices[idx[0]];
+		const QuantizedVertex& b = this->vertices[idx[1]];
+		const QuantizedVertex& c = this->vertices[idx[2]];
+		float w = 1.0f - hit->u - hit->v;
+
+		Vector3 na = this->decodeNormal(a);
+		Vector3 nb = this->decodeNormal(b);
+		Vector3 nc = this->decodeNormal(c);
+		hit->normal = normalize(add(add(mul(na, w), mul(nb, hit->u)), mul(nc, hit->v)));
+
+		Vector2 ta = this->decodeUV(a);
+		Vector2 tb = this->decodeUV(b);
+		Vector2 tc = this->decodeUV(c);
+		hit->uv = {
+			ta.x * w + tb.x * hit->u + tc.x * hit->v,
+			ta.y * w + tb.y * hit->u + tc.y * hit->v
+		};
+	};
+
+};
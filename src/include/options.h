@@ -0,0 +1,193 @@
+#pragma once
+
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+namespace tracer {
+
+	// Structs //
+	struct RenderOptions {
+		bool headless;
+		std::string scene;
+		int width;
+		int height;
+		int samples;          // per pixel, upper bound when adaptive
+		float threshold;      // adaptive error threshold, 0 renders every pixel to samples
+		int threads;          // 0 uses every core
+		std::string output;
+		int memory;           // MB for a streamed render, 0 for the default bands
+		std::string filter;   // post filter for streamed renders, "none", "firefly" or "gaussian"
+		int frames;           // animation length, 0 renders a still
+		std::string path;     // camera keyframe file for animations, empty orbits the scene
+		std::string checkpoint;   // file progressive renders save to and resume from, empty for none
+		int checkpointSeconds;
+		std::string coordinator;  // address to hand tiles out on, empty renders locally
+		std::string worker;       // coordinator address to render tiles for
+		int tileTimeout;          // seconds a worker may take for a tile before it is reassigned
+		unsigned int seed;
+		std::string sampler;      // "random" (hashed jitter), "sobol", "halton" or "bluenoise"
+		int firstSample;          // with lastSample > 0 renders only these sample indices to a partial file
+		int lastSample;
+		std::string merge;        // comma separated partial files to combine into output
+	};
+
+	// a whole number flag and the field it sets
+	struct IntOption {
+		const char* flag;
+		int* field;
+		long min;
+		long max;
+	};
+
+	// Methods //
+	RenderOptions defaultOptions() {
+		RenderOptions options;
+		options.headless = false;
+		options.scene = "demo";
+		options.width = 800;
+		options.height = 800;
+		options.samples = 64;
+		options.threshold = 0.0f;
+		options.threads = 0;
+		options.output = "render.png";
+		options.memory = 0;
+		options.filter = "none";
+		options.frames = 0;
+		options.path = "";
+		options.checkpoint = "";
+		options.checkpointSeconds = 60;
+		options.coordinator = "";
+		options.worker = "";
+		options.tileTimeout = 60;
+		options.seed = 0;
+		options.sampler = "random";
+		options.firstSample = 0;
+		options.lastSample = 0;
+		options.merge = "";
+		return options;
+	}
+
+	void printUsage(const char* program) {
+		std::cerr << "usage: " << program << " [--headless] [--scene name] [--width w] [--height h]" << std::endl
+			<< "       [--samples n] [--threshold e] [--threads n] [--output path]" << std::endl
+			<< "       [--memory mb] [--filter none|firefly|gaussian] [--frames n] [--path keyframes]" << std::endl
+			<< "       [--checkpoint file] [--checkpoint-seconds n]" << std::endl
+			<< "       [--coordinator address] [--worker address] [--tile-timeout seconds]" << std::endl
+			<< "       [--seed n] [--sampler random|sobol|halton|bluenoise]" << std::endl
+			<< "       [--sample-range first:last] [--merge a.part,b.part]" << std::endl
+			<< "scenes are demo, terrain, cubicmap, mesh (16 byte quantized vertices) and mesh-full (the same mesh at 32 bytes)" << std::endl
+			<< ".ppm, .pfm and .tlf outputs are streamed in bands, --memory and --filter apply to those" << std::endl
+			<< "--frames writes a numbered file per frame, output may hold a printf pattern such as frame_%04d.png" << std::endl
+			<< "--checkpoint saves progressive renders every n seconds (0 after every pass) and resumes them after a kill" << std::endl
+			<< "--coordinator renders with worker processes started with --worker, addresses are host:port or unix:/path" << std::endl
+			<< "--sample-range writes the sums of those samples to output, --merge adds ranges together exactly" << std::endl;
+	}
+
+	IntOption* findIntOption(IntOption* options, size_t count, const std::string& flag) {
+		for (size_t i = 0; i < count; i++) {
+			if (flag == options[i].flag) {
+				return &options[i];
+			}
+		}
+		return NULL;
+	}
+
+	// false on an unknown flag or a missing or bad value, the message is already printed
+	bool parseOptions(int argc, char** argv, RenderOptions* options) {
+		*options = defaultOptions();
+		// whole number flags with the range each accepts, anything past it is a typo rather than a render
+		IntOption integers[] = {
+			{ "--width", &options->width, 1, 65536 },
+			{ "--height", &options->height, 1, 65536 },
+			{ "--samples", &options->samples, 1, 1 << 20 },
+			{ "--threads", &options->threads, 0, 1024 },
+			{ "--memory", &options->memory, 0, 1 << 20 },
+			{ "--frames", &options->frames, 0, 1000000 },
+			{ "--checkpoint-seconds", &options->checkpointSeconds, 0, 86400 },
+			{ "--tile-timeout", &options->tileTimeout, 1, 86400 }
+		};
+		for (int i = 1; i < argc; i++) {
+			std::string flag = argv[i];
+			if (flag == "--headless") {
+				options->headless = true;
+				continue;
+			}
+			if (flag == "--help" || flag == "-h") {
+				return false;
+			}
+			if (i + 1 >= argc) {
+				std::cerr << "missing value for " << flag << std::endl;
+				return false;
+			}
+
+			std::string value = argv[++i];
+			char* end = NULL;
+			if (flag == "--scene") {
+				options->scene = value;
+			} else if (flag == "--output") {
+				options->output = value;
+			} else if (flag == "--path") {
+				options->path = value;
+			} else if (flag == "--checkpoint") {
+				options->checkpoint = value;
+			} else if (flag == "--coordinator") {
+				options->coordinator = value;
+			} else if (flag == "--worker") {
+				options->worker = value;
+			} else if (flag == "--merge") {
+				options->merge = value;
+			} else if (flag == "--sample-range") {
+				int first = 0;
+				int last = 0;
+				char rest = 0;
+				if (std::sscanf(value.c_str(), "%d:%d%c", &first, &last, &rest) != 2 || first < 0 || last <= first) {
+					std::cerr << "bad value for " << flag << ": " << value << std::endl;
+					return false;
+				}
+				options->firstSample = first;
+				options->lastSample = last;
+			} else if (flag == "--seed") {
+				unsigned long number = std::strtoul(value.c_str(), &end, 10);
+				if (value.empty() || *end != '\0' || value[0] == '-' || number > UINT_MAX) {
+					std::cerr << "bad value for " << flag << ": " << value << std::endl;
+					return false;
+				}
+				options->seed = (unsigned int) number;
+			} else if (flag == "--sampler") {
+				if (value != "random" && value != "sobol" && value != "halton" && value != "bluenoise") {
+					std::cerr << "bad value for " << flag << ": " << value << std::endl;
+					return false;
+				}
+				options->sampler = value;
+			} else if (flag == "--filter") {
+				if (value != "none" && value != "firefly" && value != "gaussian") {
+					std::cerr << "bad value for " << flag << ": " << value << std::endl;
+					return false;
+				}
+				options->filter = value;
+			} else if (IntOption* integer = findIntOption(integers, sizeof(integers) / sizeof(integers[0]), flag)) {
+				long number = std::strtol(value.c_str(), &end, 10);
+				if (value.empty() || *end != '\0' || number < integer->min || number > integer->max) {
+					std::cerr << "bad value for " << flag << ": " << value << " (" << integer->min << " to " << integer->max << ")" << std::endl;
+					return false;
+				}
+				*integer->field = (int) number;
+			} else if (flag == "--threshold") {
+				float number = std::strtof(value.c_str(), &end);
+				if (*end != '\0' || number < 0.0f) {
+					std::cerr << "bad value for " << flag << ": " << value << std::endl;
+					return false;
+				}
+				options->threshold = number;
+			} else {
+				std::cerr << "unknown option " << flag << std::endl;
+				return false;
+			}
+		}
+		return true;
+	}
+
+};
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "raylib.h"
+
+namespace tracer {
+
+	// Structs //
+	struct PartialHeader {
+		char magic[8];                 // "TRPART1\0"
+		int width;
+		int height;
+		int firstSample;
+		int lastSample;                // exclusive
+		unsigned long long key;        // hash of everything the samples depend on
+	};
+
+	// Classes //
+	// Radiance sums over one range of sample indices, for splitting a render across
+	// processes or runs. The sums are 64 bit fixed point rather than float, so adding
+	// ranges is exact integer addition: any split of [0, n) merges to the same bits as
+	// rendering [0, n) in one go, whatever the order of the merges.
+	class PartialImage {
+		public:
+			int width;
+			int height;
+			int firstSample;
+			int lastSample;
+			unsigned long long key;
+			std::vector<long long> sums;   // 3 per pixel, radiance * FIXED_ONE
+
+			// 2^24 steps per unit keeps the float precision of radiance around 1 and leaves
+			// room for 2^39 in a pixel sum, plenty for HDR values times thousands of samples
+			static constexpr double FIXED_ONE = 16777216.0;
+
+			PartialImage();
+			~PartialImage();
+
+			void reset(int width, int height, int firstSample, int lastSample, unsigned long long key);
+			// NaN and infinite samples add nothing, like a miss
+			void add(size_t index, Vector3 radiance);
+			// adds a range that starts where this one ends or ends where this one starts,
+			// false when the renders or the ranges do not fit together
+			bool merge(const PartialImage& other);
+			// per pixel mean over the range
+			void resolve(Vector3* pixels);
+
+			bool save(const std::string& path);
+			bool load(const std::string& path);
+	};
+
+	// Methods //
+	// PartialImage //
+	PartialImage::PartialImage() {
+		this->width = 0;
+		this->height = 0;
+		this->firstSample = 0;
+		this->lastSample = 0;
+		this->key = 0;
+	};
+
+	PartialImage::~PartialImage() {
+
+	};
+
+	void PartialImage::reset(int width, int height, int firstSample, int lastSample, unsigned long long key) {
+		this->width = width;
+		this->height = height;
+		this->firstSample = firstSample;
+		this->lastSample = lastSample;
+		this->key = key;
+		this->sums.assign((size_t) width * height * 3, 0);
+	};
+
+	void PartialImage::add(size_t index, Vector3 radiance) {
+		float channels[3] = { radiance.x, radiance.y, radiance.z };
+		for (int c = 0; c < 3; c++) {
+			if (std::isfinite(channels[c])) {
+				this->sums[index * 3 + c] += std::llround(channels[c] * FIXED_ONE);
+			}
+		}
+	};
+
+	bool PartialImage::merge(const PartialImage& other) {
+		if (other.width != this->width || other.height != this->height || other.key != this->key) {
+			std::cerr << "partial renders of different images can not be merged" << std::endl;
+			return false;
+		}
+		if (other.firstSample != this->lastSample && other.lastSample != this->firstSample) {
+			std::cerr << "sample range " << other.firstSample << ":" << other.lastSample << " does not continue "
+				<< this->firstSample << ":" << this->lastSample << std::endl;
+			return false;
+		}
+		for (size_t i = 0; i < this->sums.size(); i++) {
+			this->sums[i] += other.sums[i];
+		}
+		this->firstSample = std::min(this->firstSample, other.firstSample);
+		this->lastSample = std::max(this->lastSample, other.lastSample);
+		return true;
+	};
+
+	void PartialImage::resolve(Vector3* pixels) {
+		double scale = 1.0 / (FIXED_ONE * std::max(1, this->lastSample - this->firstSample));
+		for (size_t i = 0; i < (size_t) this->width * this->height; i++) {
+			pixels[i] = { (float) (this->sums[i * 3] * scale), (float) (this->sums[i * 3 + 1] * scale), (float) (this->sums[i * 3 + 2] * scale) };
+		}
+	};
+
+	bool PartialImage::save(const std::string& path) {
+		FILE* file = fopen(path.c_str(), "wb");
+		if (file == NULL) {
+			std::cerr << "could not open " << path << std::endl;
+			return false;
+		}
+		PartialHeader header;
+		std::memset(&header, 0, sizeof(header));
+		std::memcpy(header.magic, "TRPART1", 8);
+		header.width = this->width;
+		header.height = this->height;
+		header.firstSample = this->firstSample;
+		header.lastSample = this->lastSample;
+		header.key = this->key;
+		bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+			&& fwrite(this->sums.data(), sizeof(long long), this->sums.size(), file) == this->sums.size();
+		ok = fclose(file) == 0 && ok;
+		return ok;
+	};
+
+	bool PartialImage::load(const std::string& path) {
+		FILE* file = fopen(path.c_str(), "rb");
+		if (file == NULL) {
+			std::cerr << "could not open " << path << std::endl;
+			return false;
+		}
+		PartialHeader header;
+		bool ok = fread(&header, sizeof(header), 1, file) == 1 && std::memcmp(header.magic, "TRPART1", 8) == 0
+			&& header.width > 0 && header.height > 0 && header.firstSample < header.lastSample;
+		if (ok) {
+			this->reset(header.width, header.height, header.firstSample, header.lastSample, header.key);
+			ok = fread(this->sums.data(), sizeof(long long), this->sums.size(), file) == this->sums.size();
+		}
+		fclose(file);
+		if (!ok) {
+			std::cerr << path << " is not a partial render" << std::endl;
+		}
+		return ok;
+	};
+
+};
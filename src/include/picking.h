@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include "raylib.h"
+#include "enum.h"
+#include "geometry.h"
+#include "scene.h"
+
+namespace tracer {
+
+	// Structs //
+	struct RaycastParams {
+		enumerations::RaycastType filterType;
+		std::vector<int> filterList;     // scene object ids
+	};
+
+	struct PickResult {
+		bool hit;
+		int objectId;
+		int triangle;        // primitive index inside the object (triangle for meshes)
+		float u, v;          // barycentrics of the 2nd and 3rd vertex for meshes
+		float distance;
+		Vector3 point;
+		Vector3 normal;
+	};
+
+	// Methods //
+	// Same ray GetMouseRay builds, without needing a window so it also works headless.
+	inline Ray screenRay(Camera camera, Vector2 position, int width, int height) {
+		float aspect = (float) width / (float) height;
+		float ndcX = (2.0f * position.x) / (float) width - 1.0f;
+		float ndcY = 1.0f - (2.0f * position.y) / (float) height;
+
+		Vector3 forward = geometry::normalize(geometry::sub(camera.target, camera.position));
+		Vector3 right = geometry::normalize(geometry::cross(forward, camera.up));
+		Vector3 up = geometry::cross(right, forward);
+
+		Ray ray;
+		if (camera.projection == CAMERA_ORTHOGRAPHIC) {
+			float top = camera.fovy * 0.5f;
+			ray.position = geometry::add(camera.position, geometry::add(geometry::mul(right, ndcX * top * aspect), geometry::mul(up, ndcY * top)));
+			ray.direction = forward;
+		} else {
+			float tanHalf = std::tan(camera.fovy * 0.5f * DEG2RAD);
+			ray.position = camera.position;
+			ray.direction = geometry::normalize(geometry::add(forward, geometry::add(geometry::mul(right, ndcX * tanHalf * aspect), geometry::mul(up, ndcY * tanHalf))));
+		}
+		return ray;
+	}
+
+	// Picks through the scene hierarchy instead of GetRayCollisionMesh over every model.
+	// params may be NULL to consider every object.
+	inline PickResult pick(Scene* scene, Camera camera, Vector2 mousePosition, int width, int height, RaycastParams* params) {
+		Ray ray = screenRay(camera, mousePosition, width, height);
+		geometry::HitRecord hit = geometry::emptyHit();
+		bool found;
+
+		if (params == NULL || (params->filterType == enumerations::Blacklist && params->filterList.empty())) {
+			found = scene->intersect(ray, FLT_MAX, &hit);
+		} else {
+			std::vector<int> sorted = params->filterList;
+			std::sort(sorted.begin(), sorted.end());
+			bool whitelist = params->filterType == enumerations::Whitelist;
+			found = scene->intersectWhere(ray, FLT_MAX, &hit, [&](int objectId) {
+				return std::binary_search(sorted.begin(), sorted.end(), objectId) == whitelist;
+			});
+		}
+
+		PickResult result;
+		result.hit = found;
+		result.objectId = found ? hit.objectId : -1;
+		result.triangle = found ? hit.primitiveId : -1;
+		result.u = hit.u;
+		result.v = hit.v;
+		result.distance = hit.distance;
+		result.point = hit.point;
+		result.normal = hit.normal;
+		return result;
+	}
+
+	inline PickResult pick(Scene* scene, Camera camera, Vector2 mousePosition, RaycastParams* params) {
+		return pick(scene, camera, mousePosition, GetScreenWidth(), GetScreenHeight(), params);
+	}
+
+};
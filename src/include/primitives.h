@@ -0,0 +1,417 @@
+#pragma once
+
+#include <cmath>
+#include "raylib.h"
+#include "geometry.h"
+
+namespace geometry {
+
+	// Local Frames //
+	// orthonormal basis around a unit axis (Duff et al. 2017), the axis becomes local +Y
+	struct AxisFrame {
+		Vector3 tangent;
+		Vector3 axis;
+		Vector3 bitangent;
+	};
+
+	inline AxisFrame axisFrame(Vector3 axis) {
+		float sign = std::copysign(1.0f, axis.z);
+		float a = -1.0f / (sign + axis.z);
+		float b = axis.x * axis.y * a;
+		AxisFrame frame;
+		frame.tangent = vec3(1.0f + sign * axis.x * axis.x * a, sign * b, -sign * axis.x);
+		frame.axis = axis;
+		frame.bitangent = vec3(b, sign + axis.y * axis.y * a, -axis.y);
+		return frame;
+	}
+
+	inline Vector3 toLocal(const AxisFrame& frame, Vector3 v) {
+		return vec3(dot(v, frame.tangent), dot(v, frame.axis), dot(v, frame.bitangent));
+	}
+
+	inline Vector3 toWorld(const AxisFrame& frame, Vector3 v) {
+		return add(add(mul(frame.tangent, v.x), mul(frame.axis, v.y)), mul(frame.bitangent, v.z));
+	}
+
+	// half extent of a disc of the given radius whose normal is axis, per world axis
+	inline Vector3 discExtent(Vector3 axis, float radius) {
+		return vec3(
+			radius * std::sqrt(std::max(0.0f, 1.0f - axis.x * axis.x)),
+			radius * std::sqrt(std::max(0.0f, 1.0f - axis.y * axis.y)),
+			radius * std::sqrt(std::max(0.0f, 1.0f - axis.z * axis.z))
+		);
+	}
+
+	// Root Finding //
+	// real roots of a*t^2 + b*t + c in ascending order, returns the count
+	inline int solveQuadratic(double a, double b, double c, double* roots) {
+		if (a == 0.0) {
+			if (b == 0.0) {
+				return 0;
+			}
+			roots[0] = -c / b;
+			return 1;
+		}
+		double disc = b * b - 4.0 * a * c;
+		if (disc < 0.0) {
+			return 0;
+		}
+		// avoid cancellation by never subtracting nearly equal values
+		double q = -0.5 * (b + std::copysign(std::sqrt(disc), b));
+		double r0 = q / a;
+		double r1 = (q != 0.0) ? c / q : r0;
+		roots[0] = std::min(r0, r1);
+		roots[1] = std::max(r0, r1);
+		return 2;
+	}
+
+	// real roots of a*t^3 + b*t^2 + c*t + d in ascending order, returns the count
+	inline int solveCubic(double a, double b, double c, double d, double* roots) {
+		if (a == 0.0) {
+			return solveQuadratic(b, c, d, roots);
+		}
+		b /= a; c /= a; d /= a;
+		double q = (b * b - 3.0 * c) / 9.0;
+		double r = (2.0 * b * b * b - 9.0 * b * c + 27.0 * d) / 54.0;
+		double shift = b / 3.0;
+		int count;
+
+		if (r * r < q * q * q) {
+			double theta = std::acos(std::max(-1.0, std::min(1.0, r / std::sqrt(q * q * q))));
+			double m = -2.0 * std::sqrt(q);
+			roots[0] = m * std::cos(theta / 3.0) - shift;
+			roots[1] = m * std::cos((theta + 2.0 * PI) / 3.0) - shift;
+			roots[2] = m * std::cos((theta - 2.0 * PI) / 3.0) - shift;
+			count = 3;
+		} else {
+			double e = -std::copysign(std::cbrt(std::fabs(r) + std::sqrt(r * r - q * q * q)), r);
+			double f = (e != 0.0) ? q / e : 0.0;
+			roots[0] = (e + f) - shift;
+			count = 1;
+		}
+		std::sort(roots, roots + count);
+		return count;
+	}
+
+	// smallest root of the quartic inside (t0, t1). The derivative's roots split the
+	// interval into monotonic pieces, each is then bisected if its ends change sign.
+	inline bool solveQuarticInRange(const double coeffs[5], double t0, double t1, double* root) {
+		auto eval = [&](double t) {
+			return (((coeffs[4] * t + coeffs[3]) * t + coeffs[2]) * t + coeffs[1]) * t + coeffs[0];
+		};
+
+		double critical[3];
+		int criticalCount = solveCubic(4.0 * coeffs[4], 3.0 * coeffs[3], 2.0 * coeffs[2], coeffs[1], critical);
+
+		double lo = t0;
+		double flo = eval(lo);
+		if (flo == 0.0) {
+			*root = lo;
+			return true;
+		}
+		for (int i = 0; i <= criticalCount; i++) {
+			double hi = (i < criticalCount) ? critical[i] : t1;
+			if (hi <= lo) {
+				continue;
+			}
+			hi = std::min(hi, t1);
+			double fhi = eval(hi);
+			if ((flo <= 0.0) != (fhi <= 0.0)) {
+				double a = lo, b = hi, fa = flo;
+				for (int iter = 0; iter < 48 && (b - a) > 1e-7 * std::max(1.0, std::fabs(b)); iter++) {
+					double mid = 0.5 * (a + b);
+					double fm = eval(mid);
+					if ((fa <= 0.0) != (fm <= 0.0)) {
+						b = mid;
+					} else {
+						a = mid;
+						fa = fm;
+					}
+				}
+				*root = 0.5 * (a + b);
+				return true;
+			}
+			if (hi >= t1) {
+				break;
+			}
+			lo = hi;
+			flo = fhi;
+		}
+		return false;
+	}
+
+	// Primitives //
+	// Every primitive is a small value record with
+	//   bool intersect(const Ray&, float tMin, float tMax, float* t)
+	//   void surface(Vector3 point, Vector3* normal, Vector2* uv)
+	//   BoundingBox bounds()
+	// so large numbers of them can be packed into one array under a single hierarchy.
+
+	struct Sphere {
+		Vector3 center;
+		float radius;
+
+		Sphere() : center({ 0, 0, 0 }), radius(1.0f) {}
+		Sphere(Vector3 center, float radius) : center(center), radius(radius) {}
+
+		bool intersect(const Ray& ray, float tMin, float tMax, float* t) const {
+			Vector3 oc = sub(ray.position, this->center);
+			double roots[2];
+			int count = solveQuadratic(dot(ray.direction, ray.direction), 2.0 * dot(oc, ray.direction), dot(oc, oc) - this->radius * this->radius, roots);
+			for (int i = 0; i < count; i++) {
+				if (roots[i] > tMin && roots[i] < tMax) {
+					*t = (float) roots[i];
+					return true;
+				}
+			}
+			return false;
+		}
+
+		void surface(Vector3 point, Vector3* normal, Vector2* uv) const {
+			*normal = mul(sub(point, this->center), 1.0f / this->radius);
+			uv->x = 0.5f + std::atan2(normal->z, normal->x) / (2.0f * PI);
+			uv->y = 0.5f - std::asin(std::max(-1.0f, std::min(1.0f, normal->y))) / PI;
+		}
+
+		BoundingBox bounds() const {
+			Vector3 r = vec3(this->radius, this->radius, this->radius);
+			return { sub(this->center, r), add(this->center, r) };
+		}
+	};
+
+	// capped cylinder from base along a unit axis, matching GenMeshCylinder when axis is +Y
+	struct Cylinder {
+		Vector3 base;
+		Vector3 axis;
+		float radius;
+		float height;
+
+		Cylinder() : base({ 0, 0, 0 }), axis({ 0, 1, 0 }), radius(1.0f), height(1.0f) {}
+		Cylinder(Vector3 base, float radius, float height) : base(base), axis({ 0, 1, 0 }), radius(radius), height(height) {}
+		Cylinder(Vector3 base, Vector3 axis, float radius, float height) : base(base), axis(normalize(axis)), radius(radius), height(height) {}
+
+		bool intersect(const Ray& ray, float tMin, float tMax, float* t) const {
+			AxisFrame frame = axisFrame(this->axis);
+			Vector3 o = toLocal(frame, sub(ray.position, this->base));
+			Vector3 d = toLocal(frame, ray.direction);
+			float best = tMax;
+
+			double roots[2];
+			int count = solveQuadratic(d.x * d.x + d.z * d.z, 2.0 * (o.x * d.x + o.z * d.z), o.x * o.x + o.z * o.z - this->radius * this->radius, roots);
+			for (int i = 0; i < count; i++) {
+				float y = o.y + (float) roots[i] * d.y;
+				if (roots[i] > tMin && roots[i] < best && y >= 0.0f && y <= this->height) {
+					best = (float) roots[i];
+					break;
+				}
+			}
+
+			if (d.y != 0.0f) {
+				float caps[2] = { 0.0f, this->height };
+				for (float capY : caps) {
+					float tc = (capY - o.y) / d.y;
+					float x = o.x + tc * d.x;
+					float z = o.z + tc * d.z;
+					if (tc > tMin && tc < best && x * x + z * z <= this->radius * this->radius) {
+						best = tc;
+					}
+				}
+			}
+
+			if (best < tMax) {
+				*t = best;
+				return true;
+			}
+			return false;
+		}
+
+		void surface(Vector3 point, Vector3* normal, Vector2* uv) const {
+			AxisFrame frame = axisFrame(this->axis);
+			Vector3 p = toLocal(frame, sub(point, this->base));
+			float capEpsilon = 1e-4f * std::max(1.0f, this->height);
+			if (p.y <= capEpsilon) {
+				*normal = neg(this->axis);
+			} else if (p.y >= this->height - capEpsilon) {
+				*normal = this->axis;
+			} else {
+				*normal = normalize(toWorld(frame, vec3(p.x, 0.0f, p.z)));
+			}
+			uv->x = 0.5f + std::atan2(p.z, p.x) / (2.0f * PI);
+			uv->y = p.y / this->height;
+		}
+
+		BoundingBox bounds() const {
+			Vector3 top = add(this->base, mul(this->axis, this->height));
+			Vector3 e = discExtent(this->axis, this->radius);
+			return { sub(vmin(this->base, top), e), add(vmax(this->base, top), e) };
+		}
+	};
+
+	// cone with its base disc at base and apex at base + axis * height, matching GenMeshCone when axis is +Y
+	struct Cone {
+		Vector3 base;
+		Vector3 axis;
+		float radius;
+		float height;
+
+		Cone() : base({ 0, 0, 0 }), axis({ 0, 1, 0 }), radius(1.0f), height(1.0f) {}
+		Cone(Vector3 base, float radius, float height) : base(base), axis({ 0, 1, 0 }), radius(radius), height(height) {}
+		Cone(Vector3 base, Vector3 axis, float radius, float height) : base(base), axis(normalize(axis)), radius(radius), height(height) {}
+
+		bool intersect(const Ray& ray, float tMin, float tMax, float* t) const {
+			AxisFrame frame = axisFrame(this->axis);
+			Vector3 o = toLocal(frame, sub(ray.position, this->base));
+			Vector3 d = toLocal(frame, ray.direction);
+			float best = tMax;
+
+			// x^2 + z^2 = k (h - y)^2
+			double k = (double) (this->radius / this->height) * (this->radius / this->height);
+			double hy = (double) this->height - o.y;
+			double roots[2];
+			int count = solveQuadratic(
+				(double) d.x * d.x + (double) d.z * d.z - k * d.y * d.y,
+				2.0 * ((double) o.x * d.x + (double) o.z * d.z + k * hy * d.y),
+				(double) o.x * o.x + (double) o.z * o.z - k * hy * hy,
+				roots
+			);
+			for (int i = 0; i < count; i++) {
+				float y = o.y + (float) roots[i] * d.y;
+				if (roots[i] > tMin && roots[i] < best && y >= 0.0f && y <= this->height) {
+					best = (float) roots[i];
+					break;
+				}
+			}
+
+			if (d.y != 0.0f) {
+				float tc = -o.y / d.y;
+				float x = o.x + tc * d.x;
+				float z = o.z + tc * d.z;
+				if (tc > tMin && tc < best && x * x + z * z <= this->radius * this->radius) {
+					best = tc;
+				}
+			}
+
+			if (best < tMax) {
+				*t = best;
+				return true;
+			}
+			return false;
+		}
+
+		void surface(Vector3 point, Vector3* normal, Vector2* uv) const {
+			AxisFrame frame = axisFrame(this->axis);
+			Vector3 p = toLocal(frame, sub(point, this->base));
+			if (p.y <= 1e-4f * std::max(1.0f, this->height)) {
+				*normal = neg(this->axis);
+			} else {
+				float k = (this->radius / this->height) * (this->radius / this->height);
+				*normal = normalize(toWorld(frame, vec3(p.x, k * (this->height - p.y), p.z)));
+			}
+			uv->x = 0.5f + std::atan2(p.z, p.x) / (2.0f * PI);
+			uv->y = p.y / this->height;
+		}
+
+		BoundingBox bounds() const {
+			Vector3 apex = add(this->base, mul(this->axis, this->height));
+			Vector3 e = discExtent(this->axis, this->radius);
+			return { vmin(sub(this->base, e), apex), vmax(add(this->base, e), apex) };
+		}
+	};
+
+	// ring torus around a unit axis through center
+	struct Torus {
+		Vector3 center;
+		Vector3 axis;
+		float majorRadius;
+		float minorRadius;
+
+		Torus() : center({ 0, 0, 0 }), axis({ 0, 1, 0 }), majorRadius(1.0f), minorRadius(0.25f) {}
+		Torus(Vector3 center, float majorRadius, float minorRadius) : center(center), axis({ 0, 1, 0 }), majorRadius(majorRadius), minorRadius(minorRadius) {}
+		Torus(Vector3 center, Vector3 axis, float majorRadius, float minorRadius) : center(center), axis(normalize(axis)), majorRadius(majorRadius), minorRadius(minorRadius) {}
+
+		bool intersect(const Ray& ray, float tMin, float tMax, float* t) const {
+			// clip to the bounds first, the quartic is only solved over the overlap
+			float t0;
+			BoundingBox box = this->bounds();
+			Vector3 invDir = inverseDirection(ray.direction);
+			if (!intersectBounds(ray, invDir, box, tMax, &t0)) {
+				return false;
+			}
+			float t1 = tMax;
+			for (int axisIndex = 0; axisIndex < 3; axisIndex++) {
+				float inv = component(invDir, axisIndex);
+				float ta = (component(box.min, axisIndex) - component(ray.position, axisIndex)) * inv;
+				float tb = (component(box.max, axisIndex) - component(ray.position, axisIndex)) * inv;
+				if (!std::isnan(ta) && !std::isnan(tb)) {
+					t1 = std::min(t1, std::max(ta, tb));
+				}
+			}
+			t0 = std::max(t0, tMin);
+			if (t1 <= t0) {
+				return false;
+			}
+
+			// solve relative to the entry point to keep the coefficients well conditioned
+			AxisFrame frame = axisFrame(this->axis);
+			Vector3 o = toLocal(frame, sub(rayAt(ray, t0), this->center));
+			Vector3 d = toLocal(frame, ray.direction);
+
+			double R2 = (double) this->majorRadius * this->majorRadius;
+			double r2 = (double) this->minorRadius * this->minorRadius;
+			double a = (double) d.x * d.x + (double) d.y * d.y + (double) d.z * d.z;
+			double b = 2.0 * ((double) o.x * d.x + (double) o.y * d.y + (double) o.z * d.z);
+			double c = (double) o.x * o.x + (double) o.y * o.y + (double) o.z * o.z + R2 - r2;
+			double dxz = (double) d.x * d.x + (double) d.z * d.z;
+			double odxz = (double) o.x * d.x + (double) o.z * d.z;
+			double oxz = (double) o.x * o.x + (double) o.z * o.z;
+
+			double coeffs[5] = {
+				c * c - 4.0 * R2 * oxz,
+				2.0 * b * c - 8.0 * R2 * odxz,
+				b * b + 2.0 * a * c - 4.0 * R2 * dxz,
+				2.0 * a * b,
+				a * a
+			};
+
+			// start slightly outside the box so a hit exactly on its face is still bracketed, but not
+			// before tMin. A ray leaving the surface can still find its own root just past the start,
+			// so rejected roots are stepped over until the far side turns up (four roots at most).
+			double pad = 1e-3 * (this->majorRadius + this->minorRadius);
+			double start = std::max(-pad, (double) tMin - (double) t0);
+			double root;
+			for (int attempt = 0; attempt < 4; attempt++) {
+				if (!solveQuarticInRange(coeffs, start, (double) (t1 - t0), &root)) {
+					return false;
+				}
+				float hitT = t0 + (float) root;
+				if (hitT >= tMax) {
+					return false;
+				}
+				if (hitT > tMin) {
+					*t = hitT;
+					return true;
+				}
+				// past the bisection tolerance, so the same sign change is not bracketed again
+				start = root + 1e-6 * std::max(1.0, std::fabs(root));
+			}
+			return false;
+		}
+
+		void surface(Vector3 point, Vector3* normal, Vector2* uv) const {
+			AxisFrame frame = axisFrame(this->axis);
+			Vector3 p = toLocal(frame, sub(point, this->center));
+			float ring = std::sqrt(p.x * p.x + p.z * p.z);
+			// direction from the nearest point on the core circle
+			Vector3 core = (ring > 0.0f) ? vec3(p.x / ring * this->majorRadius, 0.0f, p.z / ring * this->majorRadius) : vec3(0, 0, 0);
+			*normal = normalize(toWorld(frame, sub(p, core)));
+			uv->x = 0.5f + std::atan2(p.z, p.x) / (2.0f * PI);
+			uv->y = 0.5f + std::atan2(p.y, ring - this->majorRadius) / (2.0f * PI);
+		}
+
+		BoundingBox bounds() const {
+			Vector3 e = add(discExtent(this->axis, this->majorRadius), vec3(this->minorRadius, this->minorRadius, this->minorRadius));
+			return { sub(this->center, e), add(this->center, e) };
+		}
+	};
+
+};
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace mathlib {
+
+	// Classes //
+	// PCG32 (XSH RR): 64 bits of state, 32 bit outputs. Generators with different streams
+	// are independent sequences even with the same seed, so every thread can have its
+	// own without any sharing.
+	class Pcg32 {
+		public:
+			Pcg32();
+			Pcg32(uint64_t seed, uint64_t stream);
+			~Pcg32();
+
+			void seed(uint64_t seed, uint64_t stream);
+			uint32_t next();
+			// in [0, bound) without modulo bias, bound 0 gives 0
+			uint32_t below(uint32_t bound);
+			// in [0, 1), 24 bits so every value is exact in a float
+			float nextFloat();
+
+		private:
+			uint64_t state;
+			uint64_t increment;
+	};
+
+	// Eight xoshiro128+ generators side by side, one per lane. Every step is the same
+	// 32 bit add, xor and shift on all eight lanes, which the compiler turns into vector
+	// instructions without intrinsics, so filling a buffer costs a fraction of a scalar
+	// generator. Lanes are seeded through splitmix64 and do not overlap in practice.
+	class Xoshiro128x8 {
+		public:
+			static const int LANES = 8;
+
+			Xoshiro128x8();
+			Xoshiro128x8(uint64_t seed, uint64_t stream);
+			~Xoshiro128x8();
+
+			void seed(uint64_t seed, uint64_t stream);
+			// one output per lane
+			void next(uint32_t* out);
+			// count floats in [0, 1)
+			void fill(float* out, size_t count);
+
+		private:
+			alignas(32) uint32_t s0[LANES];
+			alignas(32) uint32_t s1[LANES];
+			alignas(32) uint32_t s2[LANES];
+			alignas(32) uint32_t s3[LANES];
+	};
+
+	// Methods //
+	Pcg32& threadRandom();
+
+	// 24 high bits to [0, 1)
+	inline float toUnitFloat(uint32_t bits) {
+		return (bits >> 8) * (1.0f / 16777216.0f);
+	}
+
+	inline uint64_t splitMix64(uint64_t* state) {
+		uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+		return z ^ (z >> 31);
+	}
+
+	// this thread's generator, each thread on its own stream
+	Pcg32& threadRandom() {
+		static std::atomic<uint64_t> streams(0);
+		thread_local Pcg32 random(0x853c49e6748fea9bull, streams.fetch_add(1));
+		return random;
+	}
+
+	// Pcg32 //
+	Pcg32::Pcg32() {
+		this->seed(0x853c49e6748fea9bull, 0);
+	};
+
+	Pcg32::Pcg32(uint64_t seed, uint64_t stream) {
+		this->seed(seed, stream);
+	};
+
+	Pcg32::~Pcg32() {
+
+	};
+
+	void Pcg32::seed(uint64_t seed, uint64_t stream) {
+		this->state = 0;
+		this->increment = (stream << 1) | 1;
+		this->next();
+		this->state += seed;
+		this->next();
+	};
+
+	uint32_t Pcg32::next() {
+		uint64_t old = this->state;
+		this->state = old * 6364136223846793005ull + this->increment;
+		uint32_t shifted = (uint32_t) (((old >> 18) ^ old) >> 27);
+		uint32_t rotation = (uint32_t) (old >> 59);
+		return (shifted >> rotation) | (shifted << ((32 - rotation) & 31));
+	};
+
+	// Lemire's multiply and shift, rejecting only the few low products that would bias it
+	uint32_t Pcg32::below(uint32_t bound) {
+		uint64_t product = (uint64_t) this->next() * bound;
+		uint32_t low = (uint32_t) product;
+		if (low < bound) {
+			uint32_t threshold = (0u - bound) % bound;
+			while (low < threshold) {
+				product = (uint64_t) this->next() * bound;
+				low = (uint32_t) product;
+			}
+		}
+		return (uint32_t) (product >> 32);
+	};
+
+	float Pcg32::nextFloat() {
+		return toUnitFloat(this->next());
+	};
+
+	// Xoshiro128x8 //
+	Xoshiro128x8::Xoshiro128x8() {
+		this->seed(0, 0);
+	};
+
+	Xoshiro128x8::Xoshiro128x8(uint64_t seed, uint64_t stream) {
+		this->seed(seed, stream);
+	};
+
+	Xoshiro128x8::~Xoshiro128x8() {
+
+	};
+
+	void Xoshiro128x8::seed(uint64_t seed, uint64_t stream) {
+		uint64_t mix = seed ^ (stream * 0xd1342543de82ef95ull);
+		for (int lane = 0; lane < LANES; lane++) {
+			uint64_t a = splitMix64(&mix);
+			uint64_t b = splitMix64(&mix);
+			this->s0[lane] = (uint32_t) a;
+			this->s1[lane] = (uint32_t) (a >> 32);
+			this->s2[lane] = (uint32_t) b;
+			this->s3[lane] = (uint32_t) (b >> 32) | 1;   // never all zero
+		}
+	};
+
+	// out may point anywhere, the state is stepped in locals so the compiler does not have
+	// to assume a store to out changes it, which would keep the lane loop scalar
+	void Xoshiro128x8::next(uint32_t* out) {
+		alignas(32) uint32_t a[LANES], b[LANES], c[LANES], d[LANES], result[LANES];
+		for (int lane = 0; lane < LANES; lane++) {
+			a[lane] = this->s0[lane];
+			b[lane] = this->s1[lane];
+			c[lane] = this->s2[lane];
+			d[lane] = this->s3[lane];
+		}
+		for (int lane = 0; lane < LANES; lane++) {
+			uint32_t t = b[lane] << 9;
+			result[lane] = a[lane] + d[lane];
+			c[lane] ^= a[lane];
+			d[lane] ^= b[lane];
+			b[lane] ^= c[lane];
+			a[lane] ^= d[lane];
+			c[lane] ^= t;
+			d[lane] = (d[lane] << 11) | (d[lane] >> 21);
+		}
+		for (int lane = 0; lane < LANES; lane++) {
+			this->s0[lane] = a[lane];
+			this->s1[lane] = b[lane];
+			this->s2[lane] = c[lane];
+			this->s3[lane] = d[lane];
+			out[lane] = result[lane];
+		}
+	};
+
+	void Xoshiro128x8::fill(float* out, size_t count) {
+		alignas(32) uint32_t bits[LANES];
+		size_t i = 0;
+		for (; i + LANES <= count; i += LANES) {
+			this->next(bits);
+			for (int lane = 0; lane < LANES; lane++) {
+				out[i + lane] = toUnitFloat(bits[lane]);
+			}
+		}
+		if (i < count) {
+			this->next(bits);
+			for (int lane = 0; i + lane < count; lane++) {
+				out[i + lane] = toUnitFloat(bits[lane]);
+			}
+		}
+	};
+
+};
@@ -0,0 +1,985 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "raylib.h"
+#include "stringlib.h"
+#include "mathlib.h"
+#include "jobs.h"
+#include "geometry.h"
+#include "scene.h"
+#include "camera.h"
+#include "image_buffer.h"
+#include "accumulation.h"
+#include "resolution.h"
+#include "image_writer.h"
+#include "band_filter.h"
+#include "checkpoint.h"
+#include "partial.h"
+#include "color.h"
+#include "sampler.h"
+
+namespace tracer {
+
+	// Structs //
+	struct ThreadStats {
+		int tiles;
+		double busySeconds;
+		long long samples;
+	};
+
+	struct RenderStats {
+		double wallSeconds;
+		std::vector<ThreadStats> threads;
+		long long samples;        // this pass
+		long long totalSamples;   // since the accumulation started
+		int activeTiles;          // tiles this pass rendered
+		size_t streamedBytes;     // pixel memory the last streamed render held, writer included
+	};
+
+	struct TileState {
+		float error;       // largest relative error among the tile's pixels
+		int samples;       // per pixel, so far
+		bool converged;
+		float cost;        // measured seconds per sample per pixel, 0 until first rendered
+	};
+
+	// Shading //
+	inline Vector3 skyColor(Vector3 direction) {
+		float t = 0.5f * (direction.y + 1.0f);
+		return geometry::add(geometry::mul(geometry::vec3(1.0f, 1.0f, 1.0f), 1.0f - t), geometry::mul(geometry::vec3(0.5f, 0.7f, 1.0f), t));
+	}
+
+	// direct light from one sun plus a sky ambient term, linear radiance.
+	// primary may be NULL, otherwise it receives the camera ray's hit.
+	Vector3 shade(Scene* scene, const Ray& ray, geometry::HitRecord* primary) {
+		geometry::HitRecord hit = geometry::emptyHit();
+		bool found = scene->intersect(ray, FLT_MAX, &hit);
+		if (primary != NULL) {
+			*primary = hit;
+		}
+		if (!found) {
+			return skyColor(ray.direction);
+		}
+
+		Vector3 normal = hit.normal;
+		if (geometry::dot(normal, ray.direction) > 0.0f) {
+			normal = geometry::neg(normal);
+		}
+
+		Color c = scene->objects[hit.objectId]->color;
+		Vector3 albedo = { c.r / 255.0f, c.g / 255.0f, c.b / 255.0f };
+
+		const Vector3 sunDirection = geometry::normalize({ 0.5f, 1.0f, 0.3f });
+		const Vector3 sunColor = { 1.0f, 0.95f, 0.85f };
+		float ndl = std::max(0.0f, geometry::dot(normal, sunDirection));
+		if (ndl > 0.0f) {
+			Ray shadowRay = { geometry::add(hit.point, geometry::mul(normal, 1e-3f)), sunDirection };
+			if (scene->occluded(shadowRay, FLT_MAX)) {
+				ndl = 0.0f;
+			}
+		}
+
+		Vector3 ambient = geometry::mul(skyColor(normal), 0.25f);
+		return geometry::mul(albedo, geometry::add(ambient, geometry::mul(sunColor, ndl)));
+	}
+
+	// linear radiance to 8-bit sRGB, clamped to [0, 1]
+	inline Color toDisplayColor(Vector3 radiance) {
+		return {
+			(unsigned char) Color3::toByte(Color3::linearToSrgbFast(radiance.x)),
+			(unsigned char) Color3::toByte(Color3::linearToSrgbFast(radiance.y)),
+			(unsigned char) Color3::toByte(Color3::linearToSrgbFast(radiance.z)),
+			255
+		};
+	}
+
+	static_assert(sizeof(Vector3) == sizeof(Color3::Color3) && sizeof(Color) == 4, "radiance converts as packed Color3, display colors as RGBA8");
+
+	// toDisplayColor over count pixels through the vectorised span conversions, same results
+	void toDisplayColors(const Vector3* radiance, Color* out, size_t count) {
+		Color3::Color3 linear[64];
+		for (size_t i = 0; i < count; i += 64) {
+			size_t n = std::min((size_t) 64, count - i);
+			std::memcpy((void*) linear, radiance + i, n * sizeof(Vector3));
+			Color3::toSRGB(linear, linear, n);
+			Color3::toRGBA8(linear, (unsigned char*) (out + i), n);
+		}
+	}
+
+	// linear pixels to a file: .ppm, .pfm and .tlf through their ImageWriter, anything
+	// else encoded by raylib from the display colors
+	bool saveImage(const std::string& filename, const Vector3* pixels, int width, int height) {
+		ImageWriter* writer = createImageWriter(filename);
+		if (writer != NULL) {
+			bool written = writer->open(filename, width, height) && writer->writeRows(0, height, pixels);
+			written = writer->close() && written;
+			delete(writer);
+			return written;
+		}
+		Image image = GenImageColor(width, height, BLACK);
+		toDisplayColors(pixels, (Color*) image.data, (size_t) width * height);
+		bool written = ExportImage(image, filename.c_str());
+		UnloadImage(image);
+		return written;
+	}
+
+	// sub pixel offset in [0, 1) for one sample of a pixel, sample 0 is the pixel center
+	inline float pixelJitter(int x, int y, int sample, int dimension, unsigned int seed) {
+		if (sample == 0) {
+			return 0.5f;
+		}
+		return mathlib::sampleFloat((unsigned int) x, (unsigned int) y, (unsigned int) sample, (unsigned int) dimension, seed);
+	}
+
+	// Classes //
+	// Splits the inactive image of an ImageDisplayBuffer into one job per tile on the
+	// job system, idle workers steal tiles so fast and slow tiles balance themselves.
+	// Every render adds jittered samples to the accumulation buffer and shows the running
+	// mean, starting over when the camera or the scene changes. The sub pixel positions
+	// come from the sampler, or from independent hashes without one.
+	//
+	// Sampling is adaptive: once a tile has minSamples, each pass gives it samples in
+	// proportion to its relative error over errorThreshold, and it is retired when the
+	// error drops below the threshold (or it reaches maxSamples). A threshold of 0 keeps
+	// every tile going, one sample per pass.
+	//
+	// When only the camera moved, the old accumulation becomes history: each pixel's first
+	// new sample is projected into the previous view and, if the depth and normal stored
+	// there agree, starts from that pixel's mean (worth at most historyLimit samples).
+	// Pixels that fail are disocclusions and get disocclusionSamples right away.
+	//
+	// With a ResolutionController attached the accumulation runs at its scale of the
+	// display size and rendered tiles are upscaled bilinearly into the display buffer.
+	// The controller is fed the wall time a full frame at the current scale would take,
+	// estimated from the measured cost per sample, so tiles dropping out as they converge
+	// do not read as spare time; it is left alone once the image has converged. History
+	// reprojects across resolution changes like across camera moves.
+	//
+	// With a frameBudget each render only dispatches the tiles of the current pass whose
+	// measured cost fits in the budget across all threads, publishes them, and picks the
+	// rest of the pass up on the next call.
+	//
+	// With a checkpoint open, the accumulation and tile states are saved to it at the end
+	// of a pass every checkpointSeconds, and openCheckpoint picks a render up from the
+	// last save. Sampling only depends on the per pixel sample counts, so a resumed render
+	// continues bit for bit where the saved one was.
+	//
+	// renderStreamed is the batch path for images too big to hold: it skips the
+	// accumulation and display buffers and hands finished bands of rows to an
+	// ImageWriter instead. The band height comes from memoryBudget, and an optional
+	// BandFilter runs over each band with the overlap it needs to be seamless.
+	class TileRenderer {
+		public:
+			static constexpr int DEFAULT_MIN_SAMPLES = 8;
+
+			Scene* scene;
+			jobs::JobSystem* pool;
+			RenderCamera camera;
+			int tileSize;
+			float errorThreshold;
+			int minSamples;
+			int maxSamples;
+			int maxSamplesPerPass;
+			double frameBudget;     // seconds per render call, 0 renders whole passes
+			bool reprojection;
+			float historyLimit;
+			int disocclusionSamples;
+			ResolutionController* resolution;   // may be NULL for a fixed full resolution
+			BandFilter* filter;                 // streamed renders only, may be NULL
+			size_t memoryBudget;                // bytes for a streamed render, 0 for two tile rows
+			Checkpoint* checkpoint;             // owned, NULL unless openCheckpoint was called
+			double checkpointSeconds;           // render time between saves
+			unsigned int seed;                  // picks one of the equally valid sample sequences
+			Sampler* sampler;                   // owned, NULL for independent hashed jitter
+			RenderStats stats;
+			AccumulationBuffer accumulation;
+			std::vector<TileState> tiles;
+
+			TileRenderer(Scene* scene, jobs::JobSystem* pool);
+			~TileRenderer();
+
+			// the next slice of the current adaptive pass, false when every tile has converged
+			bool render(bufferNamespace::ImageDisplayBuffer* buffer);
+			bool converged();
+			void resetAccumulation();
+			// samples more per pixel, returns how many were taken in all, disoccluded pixels take more
+			long long renderTile(bufferNamespace::ImageDisplayBuffer* buffer, int tileIndex, int width, int height, int samples);
+			// the whole image to an opened writer band by band, false when a write failed
+			bool renderStreamed(ImageWriter* writer, int width, int height);
+			void renderImage(Vector3* pixels, int width, int height);
+			Vector3 samplePixel(int x, int y, int width, int height, int* taken);
+			// sample indices [partial->firstSample, partial->lastSample) of every pixel, no adaptivity
+			void renderRange(PartialImage* partial);
+			std::string* statsString();
+
+			// maps the checkpoint file for a width x height render and resumes from it when it
+			// holds a save of the same render, tag names what the renderer can not see (the scene)
+			bool openCheckpoint(const std::string& path, int width, int height, const std::string& tag);
+			bool saveCheckpoint();
+			// paints the display from the whole accumulation, which nothing has shown yet after a resume
+			void redraw(bufferNamespace::ImageDisplayBuffer* buffer);
+			unsigned long long checkpointKey(int width, int height);
+			// what sample n of a pixel depends on besides the scene: the image size, camera and seed
+			unsigned long long sampleKey(int width, int height);
+
+		private:
+			RenderCamera accumulatedCamera;
+			unsigned int accumulatedVersion;
+			bool accumulationValid;
+			int tilesX;
+			AccumulationBuffer history;
+			RenderCamera historyCamera;
+			bool historyValid;
+			std::vector<int> pending;         // tiles of the current pass still to render
+			std::vector<int> pendingBudget;   // their samples per pixel
+			size_t pendingNext;
+			double averageCost;               // seconds per sample per pixel over all tiles so far
+			std::mutex statsLock;             // guards stats.threads' last slot, shared by every thread outside the pool
+
+			void startPass();
+			bool reproject(int x, int y, const geometry::HitRecord& hit);
+			void upscale(bufferNamespace::ImageDisplayBuffer* buffer, const std::vector<int>& renderedTiles);
+			void renderRows(Vector3* pixels, int width, int height, int y0, int rows);
+			void addThreadStats(const ThreadStats& local);
+			float jitter(int x, int y, int sample, int dimension);
+			void jitters(int x, int y, int firstSample, int count, int dimension, float* out);
+			double checkpointAge;             // render seconds since the last save
+	};
+
+	// pool may be NULL to use the shared job system
+	TileRenderer::TileRenderer(Scene* scene, jobs::JobSystem* pool) {
+		this->scene = scene;
+		this->pool = pool != NULL ? pool : jobs::shared();
+		this->tileSize = 32;
+		this->errorThreshold = 0.01f;
+		this->minSamples = DEFAULT_MIN_SAMPLES;
+		this->maxSamples = 1024;
+		this->maxSamplesPerPass = 4;
+		this->frameBudget = 0.0;
+		this->reprojection = true;
+		this->historyLimit = 16.0f;
+		this->disocclusionSamples = 4;
+		this->historyValid = false;
+		this->resolution = NULL;
+		this->filter = NULL;
+		this->memoryBudget = 0;
+		this->checkpoint = NULL;
+		this->checkpointSeconds = 60.0;
+		this->checkpointAge = 0.0;
+		this->seed = 0;
+		this->sampler = NULL;
+		this->stats.wallSeconds = 0;
+		this->stats.samples = 0;
+		this->stats.totalSamples = 0;
+		this->stats.activeTiles = 0;
+		this->stats.streamedBytes = 0;
+		this->accumulatedVersion = 0;
+		this->accumulationValid = false;
+		this->tilesX = 0;
+		this->pendingNext = 0;
+		this->averageCost = 0.0;
+	};
+
+	TileRenderer::~TileRenderer() {
+		delete(this->checkpoint);
+		delete(this->sampler);
+	};
+
+	long long TileRenderer::renderTile(bufferNamespace::ImageDisplayBuffer* buffer, int tileIndex, int width, int height, int samples) {
+		int x0 = (tileIndex % this->tilesX) * this->tileSize;
+		int y0 = (tileIndex / this->tilesX) * this->tileSize;
+		int x1 = std::min(x0 + this->tileSize, width);
+		int y1 = std::min(y0 + this->tileSize, height);
+
+		// shade into a local tile and hand it over with one bulk store, buffer is NULL
+		// when the accumulation is upscaled into the display afterwards
+		int w = x1 - x0;
+		Color pixels[64 * 64];
+		std::vector<Color> large;
+		Color* tile = pixels;
+		if (w * (y1 - y0) > 64 * 64) {
+			large.resize((size_t) w * (y1 - y0));
+			tile = large.data();
+		}
+
+		float error = 0.0f;
+		long long taken = 0;
+		int fewest = INT_MAX;
+		for (int y = y0; y < y1; y++) {
+			Color* row = tile + (size_t) (y - y0) * w;
+			for (int x = x0; x < x1; x++) {
+				int count = samples;
+				if (this->accumulation.samples(x, y) == 0) {
+					// the first sample goes through the pixel center and records the surface
+					geometry::HitRecord hit;
+					Ray ray = this->camera.generateRay(x + 0.5f, y + 0.5f, width, height);
+					Vector3 radiance = shade(this->scene, ray, &hit);
+					this->accumulation.setSurface(x, y, hit.hit ? hit.distance : INFINITY, hit.normal);
+					if (this->historyValid && !this->reproject(x, y, hit) && hit.hit) {
+						count = std::max(count, this->disocclusionSamples);
+					}
+					this->accumulation.add(x, y, radiance);
+					taken += 1;
+					count -= 1;
+				}
+				taken += count;
+				for (int s = 0; s < count; s++) {
+					int sample = this->accumulation.samples(x, y);
+					Ray ray = this->camera.generateRay(x + this->jitter(x, y, sample, 0), y + this->jitter(x, y, sample, 1), width, height);
+					this->accumulation.add(x, y, shade(this->scene, ray, NULL));
+				}
+				error = std::max(error, this->accumulation.relativeError(x, y));
+				fewest = std::min(fewest, this->accumulation.samples(x, y));
+			}
+
+			// the finished row to display colors, one span conversion per 64 pixels
+			Vector3 means[64];
+			for (int x = x0; x < x1; x += 64) {
+				int n = std::min(64, x1 - x);
+				for (int i = 0; i < n; i++) {
+					means[i] = this->accumulation.mean(x + i, y);
+				}
+				toDisplayColors(means, row + (x - x0), (size_t) n);
+			}
+		}
+		if (buffer != NULL) {
+			buffer->writeTile(x0, y0, w, y1 - y0, tile, w);
+		}
+
+		// each tile is owned by exactly one job per pass. Its count is the least any of its
+		// pixels has, reprojected history included, so no pixel converges short of samples
+		TileState* state = &this->tiles[tileIndex];
+		state->samples = fewest;
+		state->error = error;
+		state->converged = state->samples >= this->maxSamples
+			|| (this->errorThreshold > 0.0f && state->samples >= this->minSamples && error < this->errorThreshold);
+		return taken;
+	};
+
+	bool TileRenderer::render(bufferNamespace::ImageDisplayBuffer* buffer) {
+		Image* target = buffer->GetInactive();
+		int width = target->width;
+		int height = target->height;
+		if (this->resolution != NULL) {
+			width = std::max(1, (int) std::lround(width * this->resolution->scale));
+			height = std::max(1, (int) std::lround(height * this->resolution->scale));
+		}
+		bool scaled = width != target->width || height != target->height;
+		this->tilesX = (width + this->tileSize - 1) / this->tileSize;
+		int tilesY = (height + this->tileSize - 1) / this->tileSize;
+
+		if (!this->accumulationValid || !this->camera.equals(this->accumulatedCamera) || this->scene->version != this->accumulatedVersion
+			|| this->accumulation.width != width || this->accumulation.height != height) {
+			// a camera move alone keeps what was accumulated as history to reproject from
+			this->historyValid = this->reprojection && this->accumulationValid && this->scene->version == this->accumulatedVersion;
+			if (this->historyValid) {
+				std::swap(this->history, this->accumulation);
+				this->historyCamera = this->accumulatedCamera;
+			}
+			this->accumulation.reset(width, height);
+			this->tiles.assign(this->tilesX * tilesY, { INFINITY, 0, false, 0.0f });
+			this->accumulatedCamera = this->camera;
+			this->accumulatedVersion = this->scene->version;
+			this->accumulationValid = true;
+			this->stats.totalSamples = 0;
+			this->pending.clear();
+			this->pendingBudget.clear();
+			this->pendingNext = 0;
+		}
+
+		if (this->pendingNext >= this->pending.size()) {
+			this->startPass();
+		}
+		if (this->pending.empty()) {
+			this->stats.activeTiles = 0;
+			this->stats.wallSeconds = 0;
+			this->stats.samples = 0;
+			return false;
+		}
+
+		// take tiles until their predicted cost fills the budget on every thread, always at least one
+		int threadCount = this->pool->workerCount() + 1;
+		double capacity = this->frameBudget * threadCount;
+		double predicted = 0.0;
+		std::vector<int> active;
+		std::vector<int> budget;
+		while (this->pendingNext < this->pending.size()) {
+			int index = this->pending[this->pendingNext];
+			int samples = this->pendingBudget[this->pendingNext];
+			int tileWidth = std::min(this->tileSize, width - (index % this->tilesX) * this->tileSize);
+			int tileHeight = std::min(this->tileSize, height - (index / this->tilesX) * this->tileSize);
+			float cost = this->tiles[index].cost > 0.0f ? this->tiles[index].cost : (float) this->averageCost;
+			double tileCost = (double) cost * samples * tileWidth * tileHeight;
+			if (this->frameBudget > 0.0 && !active.empty() && predicted + tileCost > capacity) {
+				break;
+			}
+			if (this->frameBudget > 0.0 && cost <= 0.0f && (int) active.size() >= threadCount) {
+				break; // nothing measured yet, one tile per thread to get an estimate
+			}
+			predicted += tileCost;
+			active.push_back(index);
+			budget.push_back(samples);
+			this->pendingNext++;
+		}
+		this->stats.activeTiles = (int) active.size();
+
+		// one slot per worker plus one shared by the calling thread and any other thread outside the pool
+		this->stats.threads.assign(this->pool->workerCount() + 1, { 0, 0.0, 0 });
+		auto start = std::chrono::steady_clock::now();
+
+		this->pool->parallelFor(0, (int) active.size(), 1, [&](int first, int last) {
+			ThreadStats local = { 0, 0.0, 0 };
+			for (int i = first; i < last; i++) {
+				int index = active[i];
+				auto tileStart = std::chrono::steady_clock::now();
+				long long taken = this->renderTile(scaled ? NULL : buffer, index, width, height, budget[i]);
+				double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - tileStart).count();
+				local.busySeconds += seconds;
+				local.tiles += 1;
+				local.samples += taken;
+
+				// smoothed so one preempted tile does not throw the next frame's estimate
+				TileState* state = &this->tiles[index];
+				float measured = (float) (seconds / (double) std::max(1LL, taken));
+				state->cost = state->cost > 0.0f ? state->cost * 0.75f + measured * 0.25f : measured;
+			}
+			this->addThreadStats(local);
+		});
+
+		this->stats.samples = 0;
+		double busySeconds = 0.0;
+		for (const ThreadStats& t : this->stats.threads) {
+			this->stats.samples += t.samples;
+			busySeconds += t.busySeconds;
+		}
+		this->stats.totalSamples += this->stats.samples;
+		if (this->stats.samples > 0) {
+			double measured = busySeconds / (double) this->stats.samples;
+			this->averageCost = this->averageCost > 0.0 ? this->averageCost * 0.75 + measured * 0.25 : measured;
+		}
+		if (scaled) {
+			this->upscale(buffer, active);
+		}
+
+		this->stats.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		this->checkpointAge += this->stats.wallSeconds;
+		if (this->pendingNext >= this->pending.size()) {
+			this->accumulation.passes += 1;
+			// a new scale takes effect on the next call, where the size mismatch restarts the accumulation
+			if (this->resolution != NULL && !this->converged()) {
+				double passBudget = 0.0;
+				for (int samples : this->pendingBudget) {
+					passBudget += samples;
+				}
+				passBudget /= (double) this->pendingBudget.size();
+				double frameCost = this->averageCost * (double) width * height * passBudget / threadCount;
+				this->resolution->update(frameCost);
+			}
+			if (this->checkpoint != NULL && this->checkpointAge >= this->checkpointSeconds) {
+				this->saveCheckpoint();
+			}
+		}
+		buffer->Flip();
+		return true;
+	};
+
+	// the sample budget of each live tile is fixed when its pass starts so jobs only touch their own tile
+	void TileRenderer::startPass() {
+		this->pending.clear();
+		this->pendingBudget.clear();
+		this->pendingNext = 0;
+		for (int i = 0; i < (int) this->tiles.size(); i++) {
+			const TileState& state = this->tiles[i];
+			if (state.converged) {
+				continue;
+			}
+			int samples = 1;
+			if (this->errorThreshold > 0.0f && state.samples >= this->minSamples) {
+				samples = std::min(this->maxSamplesPerPass, (int) std::ceil(state.error / this->errorThreshold));
+				samples = std::max(1, std::min(samples, this->maxSamples - state.samples));
+			}
+			this->pending.push_back(i);
+			this->pendingBudget.push_back(samples);
+		}
+	};
+
+	// seeds pixel (x, y) from the history where its surface was visible in the previous
+	// view. The four history pixels around the projected point are filtered bilinearly,
+	// each one only counting when it saw the same distance from the old camera within 2%
+	// and a matching normal.
+	bool TileRenderer::reproject(int x, int y, const geometry::HitRecord& hit) {
+		if (!hit.hit) {
+			return false;
+		}
+		float px, py;
+		if (!this->historyCamera.project(hit.point, this->history.width, this->history.height, &px, &py)) {
+			return false;
+		}
+		float expected = geometry::length(geometry::sub(hit.point, this->historyCamera.position));
+
+		float fx = px - 0.5f, fy = py - 0.5f;
+		int hx = (int) std::floor(fx), hy = (int) std::floor(fy);
+		float tx = fx - hx, ty = fy - hy;
+
+		Vector3 mean = { 0.0f, 0.0f, 0.0f };
+		float meanSquare = 0.0f, samples = 0.0f, weightSum = 0.0f;
+		for (int j = 0; j < 2; j++) {
+			for (int i = 0; i < 2; i++) {
+				int sx = hx + i, sy = hy + j;
+				if (sx < 0 || sy < 0 || sx >= this->history.width || sy >= this->history.height) {
+					continue;
+				}
+				size_t index = (size_t) sy * this->history.width + sx;
+				const Vector4& pixel = this->history.pixels[index];
+				if (pixel.w <= 0.0f || std::fabs(this->history.depth[index] - expected) > 0.02f * expected
+					|| geometry::dot(this->history.normals[index], hit.normal) < 0.9f) {
+					continue;
+				}
+				float weight = (i ? tx : 1.0f - tx) * (j ? ty : 1.0f - ty);
+				if (weight <= 0.0f) {
+					continue;
+				}
+				mean = geometry::add(mean, geometry::mul(geometry::vec3(pixel.x, pixel.y, pixel.z), weight / pixel.w));
+				meanSquare += this->history.squares[index] / pixel.w * weight;
+				samples += pixel.w * weight;
+				weightSum += weight;
+			}
+		}
+		if (weightSum < 1e-3f) {
+			return false;
+		}
+
+		float inverse = 1.0f / weightSum;
+		this->accumulation.seed(x, y, geometry::mul(mean, inverse), meanSquare * inverse, std::min(samples * inverse, this->historyLimit));
+		return true;
+	};
+
+	// Display pixels are filtered from the accumulation means, in linear radiance. Only
+	// display cells within reach of the rendered tiles are redone, each by one job, so
+	// no two jobs ever write the same pixel.
+	void TileRenderer::upscale(bufferNamespace::ImageDisplayBuffer* buffer, const std::vector<int>& renderedTiles) {
+		Image* target = buffer->GetInactive();
+		int displayWidth = target->width;
+		int displayHeight = target->height;
+		int width = this->accumulation.width;
+		int height = this->accumulation.height;
+		float scaleX = (float) displayWidth / (float) width;
+		float scaleY = (float) displayHeight / (float) height;
+
+		const int cellSize = 32;
+		int cellsX = (displayWidth + cellSize - 1) / cellSize;
+		int cellsY = (displayHeight + cellSize - 1) / cellSize;
+		std::vector<unsigned char> marked(cellsX * cellsY, 0);
+		for (int index : renderedTiles) {
+			int ix0 = (index % this->tilesX) * this->tileSize;
+			int iy0 = (index / this->tilesX) * this->tileSize;
+			int ix1 = std::min(ix0 + this->tileSize, width);
+			int iy1 = std::min(iy0 + this->tileSize, height);
+			// one source pixel of filter support on every side
+			int x0 = std::max(0, (int) std::floor((ix0 - 0.5f) * scaleX) - 1);
+			int y0 = std::max(0, (int) std::floor((iy0 - 0.5f) * scaleY) - 1);
+			int x1 = std::min(displayWidth - 1, (int) std::ceil((ix1 + 0.5f) * scaleX) + 1);
+			int y1 = std::min(displayHeight - 1, (int) std::ceil((iy1 + 0.5f) * scaleY) + 1);
+			for (int cy = y0 / cellSize; cy <= y1 / cellSize; cy++) {
+				for (int cx = x0 / cellSize; cx <= x1 / cellSize; cx++) {
+					marked[cy * cellsX + cx] = 1;
+				}
+			}
+		}
+		std::vector<int> cells;
+		for (int i = 0; i < cellsX * cellsY; i++) {
+			if (marked[i]) {
+				cells.push_back(i);
+			}
+		}
+
+		this->pool->parallelFor(0, (int) cells.size(), 1, [&](int first, int last) {
+			Color pixels[cellSize * cellSize];
+			for (int c = first; c < last; c++) {
+				int x0 = (cells[c] % cellsX) * cellSize;
+				int y0 = (cells[c] / cellsX) * cellSize;
+				int w = std::min(cellSize, displayWidth - x0);
+				int h = std::min(cellSize, displayHeight - y0);
+				for (int y = 0; y < h; y++) {
+					float v = std::min((float) height - 1.0f, std::max(0.0f, (y0 + y + 0.5f) / scaleY - 0.5f));
+					int sy = (int) v;
+					int sy1 = std::min(height - 1, sy + 1);
+					float ty = v - sy;
+					for (int x = 0; x < w; x++) {
+						float u = std::min((float) width - 1.0f, std::max(0.0f, (x0 + x + 0.5f) / scaleX - 0.5f));
+						int sx = (int) u;
+						int sx1 = std::min(width - 1, sx + 1);
+						float tx = u - sx;
+
+						// taps without samples yet (later in a budgeted pass) are left out
+						const int tapX[4] = { sx, sx1, sx, sx1 };
+						const int tapY[4] = { sy, sy, sy1, sy1 };
+						const float tapWeight[4] = { (1.0f - tx) * (1.0f - ty), tx * (1.0f - ty), (1.0f - tx) * ty, tx * ty };
+						Vector3 sum = { 0.0f, 0.0f, 0.0f };
+						float weight = 0.0f;
+						for (int t = 0; t < 4; t++) {
+							if (this->accumulation.samples(tapX[t], tapY[t]) > 0) {
+								sum = geometry::add(sum, geometry::mul(this->accumulation.mean(tapX[t], tapY[t]), tapWeight[t]));
+								weight += tapWeight[t];
+							}
+						}
+
+						Color* pixel = &pixels[y * w + x];
+						if (weight > 1e-4f) {
+							*pixel = toDisplayColor(geometry::mul(sum, 1.0f / weight));
+						} else if (buffer->IsFloat()) {
+							*pixel = bufferNamespace::toColor(buffer->RowFloat(y0 + y)[x0 + x]); // keep what the display shows
+						} else {
+							*pixel = buffer->Row(y0 + y)[x0 + x];
+						}
+					}
+				}
+				buffer->writeTile(x0, y0, w, h, pixels, w);
+			}
+		});
+	};
+
+	// One pixel sampled to completion on the spot: up to maxSamples, or past minSamples
+	// until the relative error drops under errorThreshold. Only depends on the pixel, the
+	// camera and the settings, so any thread or process gets the same value.
+	Vector3 TileRenderer::samplePixel(int x, int y, int width, int height, int* taken) {
+		Vector3 sum = { 0.0f, 0.0f, 0.0f };
+		float squares = 0.0f;
+		int n = 0;
+		while (n < this->maxSamples) {
+			Ray ray = this->camera.generateRay(x + this->jitter(x, y, n, 0), y + this->jitter(x, y, n, 1), width, height);
+			Vector3 radiance = shade(this->scene, ray, NULL);
+			float l = luminance(radiance);
+			sum = geometry::add(sum, radiance);
+			squares += l * l;
+			n++;
+			if (this->errorThreshold > 0.0f && n >= std::max(2, this->minSamples)) {
+				float mean = luminance(sum) / n;
+				float variance = std::max(0.0f, (squares - n * mean * mean) / (n - 1.0f));
+				if (std::sqrt(variance / n) / std::max(mean, 0.01f) < this->errorThreshold) {
+					break;
+				}
+			}
+		}
+		*taken = n;
+		return geometry::mul(sum, 1.0f / n);
+	};
+
+	// sample 0 stays on the pixel center, the sampler's sequence starts at sample 1
+	inline float TileRenderer::jitter(int x, int y, int sample, int dimension) {
+		if (sample == 0) {
+			return 0.5f;
+		}
+		if (this->sampler == NULL) {
+			return pixelJitter(x, y, sample, dimension, this->seed);
+		}
+		return this->sampler->get(x, y, sample - 1, dimension);
+	};
+
+	void TileRenderer::jitters(int x, int y, int firstSample, int count, int dimension, float* out) {
+		if (firstSample == 0 && count > 0) {
+			*out++ = 0.5f;
+			firstSample++;
+			count--;
+		}
+		if (this->sampler == NULL) {
+			for (int i = 0; i < count; i++) {
+				out[i] = pixelJitter(x, y, firstSample + i, dimension, this->seed);
+			}
+			return;
+		}
+		this->sampler->fill(x, y, firstSample - 1, count, dimension, out);
+	};
+
+	// every pixel owns its row of sums and only reads its own samples, so rows can go to
+	// any worker in any order
+	void TileRenderer::renderRange(PartialImage* partial) {
+		int width = partial->width;
+		int height = partial->height;
+		this->pool->parallelFor(0, height, 1, [&](int first, int last) {
+			for (int y = first; y < last; y++) {
+				for (int x = 0; x < width; x++) {
+					// the sub pixel positions of up to 64 samples at a time
+					float jx[64];
+					float jy[64];
+					for (int n0 = partial->firstSample; n0 < partial->lastSample; n0 += 64) {
+						int count = std::min(64, partial->lastSample - n0);
+						this->jitters(x, y, n0, count, 0, jx);
+						this->jitters(x, y, n0, count, 1, jy);
+						for (int i = 0; i < count; i++) {
+							Ray ray = this->camera.generateRay(x + jx[i], y + jy[i], width, height);
+							partial->add((size_t) y * width + x, shade(this->scene, ray, NULL));
+						}
+					}
+				}
+			}
+		});
+		this->stats.totalSamples += (long long) width * height * (partial->lastSample - partial->firstSample);
+	};
+
+	// rows y0 to y0 + rows of the image into pixels, one job per tile
+	void TileRenderer::renderRows(Vector3* pixels, int width, int height, int y0, int rows) {
+		int tileRows = (rows + this->tileSize - 1) / this->tileSize;
+		this->pool->parallelFor(0, this->tilesX * tileRows, 1, [&](int first, int last) {
+			ThreadStats local = { 0, 0.0, 0 };
+			for (int tile = first; tile < last; tile++) {
+				auto tileStart = std::chrono::steady_clock::now();
+				int x0 = (tile % this->tilesX) * this->tileSize;
+				int x1 = std::min(x0 + this->tileSize, width);
+				int ty0 = y0 + (tile / this->tilesX) * this->tileSize;
+				int ty1 = std::min(ty0 + this->tileSize, y0 + rows);
+				for (int y = ty0; y < ty1; y++) {
+					for (int x = x0; x < x1; x++) {
+						int taken = 0;
+						pixels[(size_t) (y - y0) * width + x] = this->samplePixel(x, y, width, height, &taken);
+						local.samples += taken;
+					}
+				}
+				local.tiles += 1;
+				local.busySeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - tileStart).count();
+			}
+			this->addThreadStats(local);
+		});
+	};
+
+	// a job's counts into its thread's slot. Each worker owns its slot, while every thread
+	// outside the pool that helps in wait() lands on the last one, so that one takes the lock.
+	void TileRenderer::addThreadStats(const ThreadStats& local) {
+		int slot = this->pool->currentWorker();
+		std::unique_lock<std::mutex> lock(this->statsLock, std::defer_lock);
+		if (slot >= this->pool->workerCount()) {
+			lock.lock();
+		}
+		ThreadStats* threadStats = &this->stats.threads[slot];
+		threadStats->tiles += local.tiles;
+		threadStats->busySeconds += local.busySeconds;
+		threadStats->samples += local.samples;
+	};
+
+	// one finished frame into pixels, for callers that keep whole frames such as sequences
+	void TileRenderer::renderImage(Vector3* pixels, int width, int height) {
+		this->tilesX = (width + this->tileSize - 1) / this->tileSize;
+		this->stats.threads.assign(this->pool->workerCount() + 1, { 0, 0.0, 0 });
+		auto start = std::chrono::steady_clock::now();
+		this->renderRows(pixels, width, height, 0, height);
+
+		this->stats.samples = 0;
+		for (const ThreadStats& t : this->stats.threads) {
+			this->stats.samples += t.samples;
+		}
+		this->stats.totalSamples = this->stats.samples;
+		this->stats.activeTiles = this->tilesX * ((height + this->tileSize - 1) / this->tileSize);
+		this->stats.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	};
+
+	// Bands are rendered top to bottom and each finished one is written by a job while
+	// the next renders, so memory stays a few bands whatever the image size.
+	//
+	// Without a filter two bands alternate. With one, bands render into a window that
+	// keeps the last 2 * margin rows of the band before, enough to filter every row but
+	// the last margin ones, which wait for the next band; the filtered rows go to one of
+	// two output bands. Nothing is rendered twice.
+	bool TileRenderer::renderStreamed(ImageWriter* writer, int width, int height) {
+		this->tilesX = (width + this->tileSize - 1) / this->tileSize;
+		int margin = this->filter != NULL ? this->filter->margin() : 0;
+		size_t rowBytes = (size_t) width * sizeof(Vector3);
+
+		// per band row: two render bands, or the window and two output bands
+		size_t perRow = (this->filter != NULL ? 3 : 2) * rowBytes;
+		size_t fixed = writer->memoryUsage() + (size_t) (4 * margin) * rowBytes;
+		int rows = std::min(this->tileSize, height);
+		if (this->memoryBudget > 0) {
+			if (this->memoryBudget < fixed + perRow) {
+				std::cerr << "memory budget of " << this->memoryBudget << " bytes is below the " << fixed + perRow
+					<< " needed for one row of a " << width << " pixel wide image" << std::endl;
+				return false;
+			}
+			size_t fit = (this->memoryBudget - fixed) / perRow;
+			rows = (int) std::min(fit, (size_t) height);
+			if (rows > this->tileSize) {
+				rows -= rows % this->tileSize; // whole tile rows when more than one fits
+			}
+		}
+
+		std::vector<Vector3> window((size_t) width * (rows + (this->filter != NULL ? 2 * margin : 0)));
+		std::vector<Vector3> spare;          // the second render band without a filter
+		std::vector<Vector3> outputs[2];     // filtered bands with one
+		if (this->filter != NULL) {
+			outputs[0].resize((size_t) width * (rows + margin));
+			outputs[1].resize((size_t) width * (rows + margin));
+		} else {
+			spare.resize((size_t) width * rows);
+		}
+		this->stats.streamedBytes = writer->memoryUsage() + (window.size() + spare.size() + outputs[0].size() + outputs[1].size()) * sizeof(Vector3);
+
+		this->stats.threads.assign(this->pool->workerCount() + 1, { 0, 0.0, 0 });
+		auto start = std::chrono::steady_clock::now();
+
+		jobs::Counter written;
+		std::atomic<bool> ok(true);
+		int carry = 0;       // rows kept at the top of the window
+		int filtered = 0;    // first row not filtered yet
+		for (int y0 = 0, band = 0; y0 < height; y0 += rows, band++) {
+			int count = std::min(rows, height - y0);
+			Vector3* target = this->filter == NULL && (band & 1) ? spare.data() : window.data() + (size_t) carry * width;
+			this->renderRows(target, width, height, y0, count);
+
+			Vector3* out = target;
+			int outStart = y0;
+			int outRows = count;
+			if (this->filter != NULL) {
+				int end = y0 + count == height ? height : y0 + count - margin;
+				out = outputs[band & 1].data();
+				outStart = filtered;
+				outRows = std::max(0, end - filtered);
+				RowBand input = { window.data(), width, y0 - carry, carry + count, height };
+				this->pool->parallelFor(outStart, outStart + outRows, 8, [&](int first, int last) {
+					this->filter->apply(input, first, last - first, out + (size_t) (first - outStart) * width);
+				});
+				filtered += outRows;
+			}
+
+			// the previous band has to be out before this one is queued, rows go in order
+			this->pool->wait(&written);
+			if (!ok.load()) {
+				break;
+			}
+			if (outRows > 0) {
+				this->pool->run([writer, out, outStart, outRows, &ok]() {
+					if (!writer->writeRows(outStart, outRows, out)) {
+						ok.store(false);
+					}
+				}, &written);
+			}
+
+			if (this->filter != NULL) {
+				int keep = std::min(2 * margin, y0 + count);
+				std::memmove(window.data(), window.data() + (size_t) (carry + count - keep) * width, (size_t) keep * rowBytes);
+				carry = keep;
+			}
+		}
+		this->pool->wait(&written);
+
+		this->stats.samples = 0;
+		for (const ThreadStats& t : this->stats.threads) {
+			this->stats.samples += t.samples;
+		}
+		this->stats.totalSamples = this->stats.samples;
+		this->stats.activeTiles = this->tilesX * ((height + this->tileSize - 1) / this->tileSize);
+		this->stats.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		return ok.load();
+	};
+
+	bool TileRenderer::converged() {
+		if (!this->accumulationValid) {
+			return false;
+		}
+		for (const TileState& state : this->tiles) {
+			if (!state.converged) {
+				return false;
+			}
+		}
+		return true;
+	};
+
+	// for changes render cannot see, such as moving objects without rebuilding the scene
+	void TileRenderer::resetAccumulation() {
+		this->accumulationValid = false;
+	};
+
+	// everything the samples depend on besides the scene: size, tiling, adaptive settings and camera
+	unsigned long long TileRenderer::sampleKey(int width, int height) {
+		unsigned int ints[3] = { (unsigned int) width, (unsigned int) height, this->seed };
+		std::string samplerName = this->sampler != NULL ? this->sampler->name() : "";
+		float floats[13] = {
+			this->camera.fieldOfView,
+			this->camera.position.x, this->camera.position.y, this->camera.position.z,
+			this->camera.right.x, this->camera.right.y, this->camera.right.z,
+			this->camera.up.x, this->camera.up.y, this->camera.up.z,
+			this->camera.forward.x, this->camera.forward.y, this->camera.forward.z
+		};
+		unsigned long long key = hashBytes(floats, sizeof(floats), hashBytes(ints, sizeof(ints), 0));
+		return samplerName.empty() ? key : hashBytes(samplerName.data(), samplerName.size(), key);
+	};
+
+	unsigned long long TileRenderer::checkpointKey(int width, int height) {
+		int ints[4] = { this->tileSize, this->minSamples, this->maxSamples, this->maxSamplesPerPass };
+		float threshold = this->errorThreshold;
+		return hashBytes(&threshold, sizeof(threshold), hashBytes(ints, sizeof(ints), this->sampleKey(width, height)));
+	};
+
+	bool TileRenderer::openCheckpoint(const std::string& path, int width, int height, const std::string& tag) {
+		delete(this->checkpoint);
+		this->checkpoint = new Checkpoint();
+		this->tilesX = (width + this->tileSize - 1) / this->tileSize;
+		int tilesY = (height + this->tileSize - 1) / this->tileSize;
+		unsigned long long key = hashBytes(tag.data(), tag.size(), this->checkpointKey(width, height));
+		if (!this->checkpoint->open(path, width, height, this->tilesX * tilesY, (int) sizeof(TileState), key)) {
+			delete(this->checkpoint);
+			this->checkpoint = NULL;
+			return false;
+		}
+		this->checkpointAge = 0.0;
+		if (!this->checkpoint->resumable()) {
+			return true;
+		}
+
+		// the same state render sets up for a fresh accumulation, then the saved contents
+		this->accumulation.reset(width, height);
+		this->tiles.assign(this->tilesX * tilesY, { INFINITY, 0, false, 0.0f });
+		this->accumulatedCamera = this->camera;
+		this->accumulatedVersion = this->scene->version;
+		this->accumulationValid = true;
+		this->historyValid = false;
+		this->pending.clear();
+		this->pendingBudget.clear();
+		this->pendingNext = 0;
+		return this->checkpoint->load(&this->accumulation, this->tiles.data(), &this->stats.totalSamples);
+	};
+
+	// only between passes, a pass in flight has tiles at mixed sample counts
+	bool TileRenderer::saveCheckpoint() {
+		if (this->checkpoint == NULL || !this->accumulationValid || this->pendingNext < this->pending.size()) {
+			return false;
+		}
+		this->checkpointAge = 0.0;
+		return this->checkpoint->save(this->accumulation, this->tiles.data(), this->stats.totalSamples);
+	};
+
+	void TileRenderer::redraw(bufferNamespace::ImageDisplayBuffer* buffer) {
+		if (!this->accumulationValid) {
+			return;
+		}
+		std::vector<int> all(this->tiles.size());
+		for (int i = 0; i < (int) all.size(); i++) {
+			all[i] = i;
+		}
+		this->upscale(buffer, all);
+		buffer->Flip();
+	};
+
+	// per thread utilisation is the share of the frame's wall time spent inside tiles
+	std::string* TileRenderer::statsString() {
+		std::string* out = string_format("frame %.2f ms, pass %d, %d/%d tiles active, %lld samples (%lld total), %d threads:",
+			this->stats.wallSeconds * 1e3, this->accumulation.passes, this->stats.activeTiles, (int) this->tiles.size(),
+			this->stats.samples, this->stats.totalSamples, (int) this->stats.threads.size());
+		for (size_t i = 0; i < this->stats.threads.size(); i++) {
+			const ThreadStats& t = this->stats.threads[i];
+			double utilisation = this->stats.wallSeconds > 0 ? t.busySeconds / this->stats.wallSeconds : 0.0;
+			std::string* entry = string_format(" [%d] %d tiles %.0f%%", (int) i, t.tiles, utilisation * 100.0);
+			out->append(*entry);
+			delete(entry);
+		}
+		return out;
+	};
+
+};
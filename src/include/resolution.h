@@ -0,0 +1,97 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+namespace tracer {
+
+	// Classes //
+	// Picks the render scale (fraction of the display resolution per axis) from measured
+	// frame times. It drops as soon as frames are clearly over target, sized so the
+	// pixel count fits the target, and only grows one step at a time after a long run
+	// of frames that would still fit at the larger size, so it does not oscillate.
+	class ResolutionController {
+		public:
+			double targetSeconds;
+			float scale;
+			float minScale;
+			float maxScale;
+			float step;          // scales are kept to multiples of this
+			double overRatio;    // over target by this much counts as a slow frame
+			double underRatio;   // the next step up must be predicted under target by this much
+			int overFrames;      // consecutive slow frames before shrinking
+			int underFrames;     // consecutive fast frames before growing
+
+			ResolutionController(double targetSeconds);
+			~ResolutionController();
+
+			void toDefault();
+			// feeds one frame time, true when the scale changed
+			bool update(double frameSeconds);
+
+		private:
+			double smoothed;
+			int overCount;
+			int underCount;
+	};
+
+	ResolutionController::ResolutionController(double targetSeconds) {
+		this->toDefault();
+		this->targetSeconds = targetSeconds;
+	};
+
+	ResolutionController::~ResolutionController() {
+
+	};
+
+	void ResolutionController::toDefault() {
+		this->targetSeconds = 1.0 / 60.0;
+		this->scale = 1.0f;
+		this->minScale = 0.25f;
+		this->maxScale = 1.0f;
+		this->step = 0.125f;
+		this->overRatio = 1.15;
+		this->underRatio = 0.8;
+		this->overFrames = 3;
+		this->underFrames = 30;
+		this->smoothed = 0.0;
+		this->overCount = 0;
+		this->underCount = 0;
+	};
+
+	bool ResolutionController::update(double frameSeconds) {
+		this->smoothed = this->smoothed > 0.0 ? this->smoothed * 0.7 + frameSeconds * 0.3 : frameSeconds;
+
+		if (this->smoothed > this->targetSeconds * this->overRatio) {
+			this->underCount = 0;
+			if (++this->overCount < this->overFrames || this->scale <= this->minScale) {
+				return false;
+			}
+			// frame time goes with the pixel count, so the side length goes with its square root
+			float fit = this->scale * (float) std::sqrt(this->targetSeconds / this->smoothed);
+			float next = std::max(this->minScale, std::floor(fit / this->step) * this->step);
+			next = std::max(this->minScale, std::min(next, this->scale - this->step));
+			// carry the estimate over to the new size so the next frames are judged fairly
+			this->smoothed *= (double) (next * next) / (double) (this->scale * this->scale);
+			this->scale = next;
+			this->overCount = 0;
+			return true;
+		}
+		this->overCount = 0;
+
+		float next = std::min(this->maxScale, this->scale + this->step);
+		double predicted = this->smoothed * (double) (next * next) / (double) (this->scale * this->scale);
+		if (next <= this->scale || predicted > this->targetSeconds * this->underRatio) {
+			this->underCount = 0;
+			return false;
+		}
+		if (++this->underCount < this->underFrames) {
+			return false;
+		}
+		this->smoothed = predicted;
+		this->scale = next;
+		this->underCount = 0;
+		return true;
+	};
+
+};
@@ -0,0 +1,313 @@
+#pragma once
+
+#include <vector>
+#include "raylib.h"
+#include "geometry.h"
+#include "bvh.h"
+#include "mesh.h"
+#include "primitives.h"
+
+namespace tracer {
+
+	// Classes //
+	// Anything the scene hierarchy can hold. intersect only has to fill distance, u, v and
+	// primitiveId, the scene calls fillSurface once for the closest hit.
+	class SceneObject {
+		public:
+			int id;
+			Color color;
+
+			SceneObject();
+			virtual ~SceneObject();
+
+			virtual BoundingBox bounds() = 0;
+			virtual bool intersect(const Ray& ray, float tMax, geometry::HitRecord* hit) = 0;
+			virtual void fillSurface(const Ray& ray, geometry::HitRecord* hit) = 0;
+			virtual size_t memoryUsage() = 0;
+			// after the geometry moved in place, keeps the hierarchy's topology
+			virtual void refit();
+	};
+
+	// triangle mesh with its own hierarchy, MeshT is geometry::TriangleMesh or geometry::QuantizedMesh
+	template<typename MeshT>
+	class MeshObject : public SceneObject {
+		public:
+			MeshT* mesh;
+			geometry::BVH bvh;
+
+			MeshObject(MeshT* mesh);
+			~MeshObject();
+
+			BoundingBox bounds();
+			bool intersect(const Ray& ray, float tMax, geometry::HitRecord* hit);
+			void fillSurface(const Ray& ray, geometry::HitRecord* hit);
+			size_t memoryUsage();
+			void refit();
+	};
+
+	// packed array of analytic primitives (geometry::Sphere, Cylinder, Cone, Torus) under one hierarchy
+	template<typename PrimitiveT>
+	class PrimitiveGroup : public SceneObject {
+		public:
+			std::vector<PrimitiveT> primitives;
+			geometry::BVH bvh;
+
+			PrimitiveGroup();
+			~PrimitiveGroup();
+
+			int add(const PrimitiveT& primitive);
+			void build();
+
+			BoundingBox bounds();
+			bool intersect(const Ray& ray, float tMax, geometry::HitRecord* hit);
+			void fillSurface(const Ray& ray, geometry::HitRecord* hit);
+			size_t memoryUsage();
+			void refit();
+	};
+
+	class Scene {
+		public:
+			std::vector<SceneObject*> objects;
+			geometry::BVH tlas;
+			unsigned int version;   // bumped by every build, renderers compare it to drop stale results
+
+			Scene();
+			~Scene();
+
+			int add(SceneObject* object);
+			void build();
+			// refits every object and the top level, for animation that moves but does not add or remove
+			void refit();
+
+			BoundingBox bounds();
+			bool intersect(const Ray& ray, float tMax, geometry::HitRecord* hit);
+			bool occluded(const Ray& ray, float tMax);
+			size_t memoryUsage();
+
+			// closest hit among the objects accept(objectId) returns true for, culled at the top level
+			template<typename FilterFn>
+			bool intersectWhere(const Ray& ray, float tMax, geometry::HitRecord* hit, FilterFn accept);
+	};
+
+	// SceneObject //
+	SceneObject::SceneObject() {
+		this->id = -1;
+		this->color = WHITE;
+	};
+
+	SceneObject::~SceneObject() {
+
+	};
+
+	void SceneObject::refit() {
+
+	};
+
+	// MeshObject //
+	template<typename MeshT>
+	MeshObject<MeshT>::MeshObject(MeshT* mesh) {
+		this->mesh = mesh;
+		std::vector<BoundingBox> boxes(mesh->triangleCount());
+		for (int tri = 0; tri < mesh->triangleCount(); tri++) {
+			boxes[tri] = mesh->triangleBounds(tri);
+		}
+		this->bvh.build(boxes);
+	};
+
+	template<typename MeshT>
+	MeshObject<MeshT>::~MeshObject() {
+		delete(this->mesh);
+	};
+
+	template<typename MeshT>
+	BoundingBox MeshObject<MeshT>::bounds() {
+		return this->bvh.bounds();
+	};
+
+	template<typename MeshT>
+	bool MeshObject<MeshT>::intersect(const Ray& ray, float tMax, geometry::HitRecord* hit) {
+		MeshT* mesh = this->mesh;
+		return this->bvh.traverse(ray, tMax, false, [&](int tri, float& closest) {
+			if (mesh->intersectTriangle(tri, ray, closest, hit)) {
+				closest = hit->distance;
+				return true;
+			}
+			return false;
+		});
+	};
+
+	template<typename MeshT>
+	void MeshObject<MeshT>::fillSurface(const Ray& ray, geometry::HitRecord* hit) {
+		hit->point = geometry::rayAt(ray, hit->distance);
+		this->mesh->fillSurface(hit);
+	};
+
+	template<typename MeshT>
+	size_t MeshObject<MeshT>::memoryUsage() {
+		return this->mesh->memoryUsage() + this->bvh.memoryUsage();
+	};
+
+	template<typename MeshT>
+	void MeshObject<MeshT>::refit() {
+		std::vector<BoundingBox> boxes(this->mesh->triangleCount());
+		for (int tri = 0; tri < this->mesh->triangleCount(); tri++) {
+			boxes[tri] = this->mesh->triangleBounds(tri);
+		}
+		this->bvh.refit(boxes);
+	};
+
+	// PrimitiveGroup //
+	template<typename PrimitiveT>
+	PrimitiveGroup<PrimitiveT>::PrimitiveGroup() {
+
+	};
+
+	template<typename PrimitiveT>
+	PrimitiveGroup<PrimitiveT>::~PrimitiveGroup() {
+
+	};
+
+	template<typename PrimitiveT>
+	int PrimitiveGroup<PrimitiveT>::add(const PrimitiveT& primitive) {
+		this->primitives.push_back(primitive);
+		return (int) this->primitives.size() - 1;
+	};
+
+	template<typename PrimitiveT>
+	void PrimitiveGroup<PrimitiveT>::build() {
+		std::vector<BoundingBox> boxes(this->primitives.size());
+		for (size_t i = 0; i < this->primitives.size(); i++) {
+			boxes[i] = this->primitives[i].bounds();
+		}
+		this->bvh.build(boxes);
+	};
+
+	template<typename PrimitiveT>
+	BoundingBox PrimitiveGroup<PrimitiveT>::bounds() {
+		return this->bvh.bounds();
+	};
+
+	template<typename PrimitiveT>
+	bool PrimitiveGroup<PrimitiveT>::intersect(const Ray& ray, float tMax, geometry::HitRecord* hit) {
+		const float tMin = 1e-4f;
+		std::vector<PrimitiveT>& primitives = this->primitives;
+		return this->bvh.traverse(ray, tMax, false, [&](int index, float& closest) {
+			float t;
+			if (primitives[index].intersect(ray, tMin, closest, &t)) {
+				closest = t;
+				hit->hit = true;
+				hit->distance = t;
+				hit->u = 0.0f;
+				hit->v = 0.0f;
+				hit->primitiveId = index;
+				return true;
+			}
+			return false;
+		});
+	};
+
+	template<typename PrimitiveT>
+	void PrimitiveGroup<PrimitiveT>::fillSurface(const Ray& ray, geometry::HitRecord* hit) {
+		hit->point = geometry::rayAt(ray, hit->distance);
+		this->primitives[hit->primitiveId].surface(hit->point, &hit->normal, &hit->uv);
+		hit->u = hit->uv.x;
+		hit->v = hit->uv.y;
+	};
+
+	template<typename PrimitiveT>
+	size_t PrimitiveGroup<PrimitiveT>::memoryUsage() {
+		return this->primitives.size() * sizeof(PrimitiveT) + this->bvh.memoryUsage();
+	};
+
+	template<typename PrimitiveT>
+	void PrimitiveGroup<PrimitiveT>::refit() {
+		std::vector<BoundingBox> boxes(this->primitives.size());
+		for (size_t i = 0; i < this->primitives.size(); i++) {
+			boxes[i] = this->primitives[i].bounds();
+		}
+		this->bvh.refit(boxes);
+	};
+
+	// Scene //
+	Scene::Scene() {
+		this->version = 0;
+	};
+
+	Scene::~Scene() {
+		for (SceneObject* object : this->objects) {
+			delete(object);
+		}
+	};
+
+	int Scene::add(SceneObject* object) {
+		object->id = (int) this->objects.size();
+		this->objects.push_back(object);
+		return object->id;
+	};
+
+	void Scene::build() {
+		std::vector<BoundingBox> boxes(this->objects.size());
+		for (size_t i = 0; i < this->objects.size(); i++) {
+			boxes[i] = this->objects[i]->bounds();
+		}
+		this->tlas.build(boxes);
+		this->version += 1;
+	};
+
+	void Scene::refit() {
+		std::vector<BoundingBox> boxes(this->objects.size());
+		for (size_t i = 0; i < this->objects.size(); i++) {
+			this->objects[i]->refit();
+			boxes[i] = this->objects[i]->bounds();
+		}
+		this->tlas.refit(boxes);
+		this->version += 1;
+	};
+
+	BoundingBox Scene::bounds() {
+		return this->tlas.bounds();
+	};
+
+	bool Scene::intersect(const Ray& ray, float tMax, geometry::HitRecord* hit) {
+		return this->intersectWhere(ray, tMax, hit, [](int) { return true; });
+	};
+
+	template<typename FilterFn>
+	bool Scene::intersectWhere(const Ray& ray, float tMax, geometry::HitRecord* hit, FilterFn accept) {
+		std::vector<SceneObject*>& objects = this->objects;
+		bool found = this->tlas.traverse(ray, tMax, false, [&](int index, float& closest) {
+			if (!accept(index)) {
+				return false;
+			}
+			geometry::HitRecord local = geometry::emptyHit();
+			if (objects[index]->intersect(ray, closest, &local)) {
+				local.objectId = index;
+				*hit = local;
+				closest = local.distance;
+				return true;
+			}
+			return false;
+		});
+		if (found) {
+			this->objects[hit->objectId]->fillSurface(ray, hit);
+		}
+		return found;
+	};
+
+	bool Scene::occluded(const Ray& ray, float tMax) {
+		std::vector<SceneObject*>& objects = this->objects;
+		return this->tlas.traverse(ray, tMax, true, [&](int index, float& closest) {
+			geometry::HitRecord local = geometry::emptyHit();
+			return objects[index]->intersect(ray, closest, &local);
+		});
+	};
+
+	size_t Scene::memoryUsage() {
+		size_t total = this->tlas.memoryUsage() + this->objects.size() * sizeof(SceneObject*);
+		for (SceneObject* object : this->objects) {
+			total += object->memoryUsage();
+		}
+		return total;
+	};
+
+};
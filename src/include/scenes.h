@@ -0,0 +1,212 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+#include <string>
+#include <vector>
+#include "raylib.h"
+#include "geometry.h"
+#include "scene.h"
+#include "primitives.h"
+#include "mesh.h"
+#include "heightfield.h"
+#include "voxelgrid.h"
+
+namespace tracer {
+
+	// Methods //
+	// whether buildScene knows name, without building it
+	bool isScene(const std::string& name) {
+		return name == "demo" || name == "mesh" || name == "mesh-full" || name == "terrain" || name == "cubicmap";
+	}
+
+	// Trefoil knot tube as a triangle mesh with analytic normals, centered above the origin.
+	// segments runs along the knot and sides around the tube.
+	geometry::TriangleMesh* knotMesh(int segments, int sides, float tubeRadius) {
+		geometry::TriangleMesh* mesh = new geometry::TriangleMesh();
+		auto knot = [](float t) {
+			float r = 2.0f + std::cos(3.0f * t);
+			// the knot's z becomes height so it stands up in front of the camera
+			return geometry::vec3(r * std::cos(2.0f * t) * 0.6f, std::sin(3.0f * t) * 0.6f + 1.6f, r * std::sin(2.0f * t) * 0.6f);
+		};
+
+		for (int i = 0; i <= segments; i++) {
+			float t = (float) i / (float) segments * 2.0f * PI;
+			Vector3 center = knot(t);
+			Vector3 tangent = geometry::normalize(geometry::sub(knot(t + 1e-3f), knot(t - 1e-3f)));
+			// the knot's tangent is never vertical, so the frame is defined all the way round
+			Vector3 normal = geometry::normalize(geometry::cross(tangent, geometry::vec3(0, 1, 0)));
+			Vector3 binormal = geometry::cross(tangent, normal);
+			for (int j = 0; j <= sides; j++) {
+				float a = (float) j / (float) sides * 2.0f * PI;
+				geometry::Vertex vert;
+				vert.normal = geometry::add(geometry::mul(normal, std::cos(a)), geometry::mul(binormal, std::sin(a)));
+				vert.position = geometry::add(center, geometry::mul(vert.normal, tubeRadius));
+				vert.uv = { (float) i / (float) segments, (float) j / (float) sides };
+				mesh->vertices.push_back(vert);
+				geometry::grow(&mesh->box, vert.position);
+			}
+		}
+
+		for (int i = 0; i < segments; i++) {
+			for (int j = 0; j < sides; j++) {
+				unsigned int a = (unsigned int) (i * (sides + 1) + j);
+				unsigned int b = a + (unsigned int) (sides + 1);
+				mesh->indices.insert(mesh->indices.end(), { a, b, a + 1, a + 1, b, b + 1 });
+			}
+		}
+		return mesh;
+	}
+
+	// Built-in test scenes by name, NULL when the name is unknown.
+	Scene* buildScene(const std::string& name) {
+		Scene* scene = new Scene();
+
+		if (name == "demo") {
+			PrimitiveGroup<geometry::Sphere>* spheres = new PrimitiveGroup<geometry::Sphere>();
+			spheres->color = { 230, 90, 70, 255 };
+			spheres->add(geometry::Sphere({ 0.0f, 1.0f, 0.0f }, 1.0f));
+			for (int i = 0; i < 12; i++) {
+				float angle = (float) i / 12.0f * 2.0f * PI;
+				spheres->add(geometry::Sphere({ std::cos(angle) * 3.5f, 0.35f, std::sin(angle) * 3.5f }, 0.35f));
+			}
+			spheres->build();
+			scene->add(spheres);
+
+			PrimitiveGroup<geometry::Torus>* tori = new PrimitiveGroup<geometry::Torus>();
+			tori->color = { 90, 170, 230, 255 };
+			tori->add(geometry::Torus({ 0.0f, 1.0f, 0.0f }, { 0.3f, 1.0f, 0.2f }, 1.8f, 0.15f));
+			tori->build();
+			scene->add(tori);
+
+			PrimitiveGroup<geometry::Cylinder>* cylinders = new PrimitiveGroup<geometry::Cylinder>();
+			cylinders->color = { 200, 200, 120, 255 };
+			cylinders->add(geometry::Cylinder({ -2.0f, 0.0f, -2.5f }, 0.4f, 2.5f));
+			cylinders->add(geometry::Cylinder({ 2.0f, 0.0f, -2.5f }, 0.4f, 2.5f));
+			cylinders->build();
+			scene->add(cylinders);
+
+			PrimitiveGroup<geometry::Cone>* cones = new PrimitiveGroup<geometry::Cone>();
+			cones->color = { 120, 210, 120, 255 };
+			cones->add(geometry::Cone({ 0.0f, 0.0f, -3.0f }, 0.8f, 1.6f));
+			cones->build();
+			scene->add(cones);
+
+			// ground slab
+			PrimitiveGroup<geometry::Cylinder>* ground = new PrimitiveGroup<geometry::Cylinder>();
+			ground->color = { 180, 180, 180, 255 };
+			ground->add(geometry::Cylinder({ 0.0f, -0.1f, 0.0f }, 12.0f, 0.1f));
+			ground->build();
+			scene->add(ground);
+		} else if (name == "mesh" || name == "mesh-full") {
+			// the same knot in both layouts, "mesh" traces and shades the 16 byte quantized vertices
+			geometry::TriangleMesh* knot = knotMesh(512, 24, 0.25f);
+			SceneObject* object;
+			if (name == "mesh") {
+				object = new MeshObject<geometry::QuantizedMesh>(new geometry::QuantizedMesh(knot));
+				delete(knot);
+			} else {
+				object = new MeshObject<geometry::TriangleMesh>(knot);
+			}
+			object->color = { 210, 160, 90, 255 };
+			scene->add(object);
+
+			PrimitiveGroup<geometry::Cylinder>* ground = new PrimitiveGroup<geometry::Cylinder>();
+			ground->color = { 180, 180, 180, 255 };
+			ground->add(geometry::Cylinder({ 0.0f, -0.1f, 0.0f }, 12.0f, 0.1f));
+			ground->build();
+			scene->add(ground);
+		} else if (name == "terrain") {
+			// rolling hills from a few octaves of sines, traced through the min-max mip height field
+			const int samples = 257;
+			std::vector<uint8_t> heights((size_t) samples * samples);
+			for (int z = 0; z < samples; z++) {
+				for (int x = 0; x < samples; x++) {
+					float u = (float) x / (float) (samples - 1) * 2.0f * PI;
+					float v = (float) z / (float) (samples - 1) * 2.0f * PI;
+					float h = 0.5f
+						+ 0.25f * std::sin(u * 1.5f) * std::cos(v * 1.2f)
+						+ 0.12f * std::sin(u * 4.3f + v * 2.1f)
+						+ 0.05f * std::cos(u * 11.0f - v * 9.0f);
+					heights[(size_t) z * samples + x] = (uint8_t) std::lround(std::max(0.0f, std::min(1.0f, h)) * 255.0f);
+				}
+			}
+			HeightField* terrain = new HeightField(heights, samples, samples, { -12.0f, -1.0f, -12.0f }, { 24.0f, 2.5f, 24.0f });
+			terrain->color = { 120, 170, 90, 255 };
+			scene->add(terrain);
+
+			PrimitiveGroup<geometry::Sphere>* spheres = new PrimitiveGroup<geometry::Sphere>();
+			spheres->color = { 230, 90, 70, 255 };
+			spheres->add(geometry::Sphere({ 0.0f, 1.6f, 0.0f }, 0.8f));
+			spheres->build();
+			scene->add(spheres);
+		} else if (name == "cubicmap") {
+			// a small maze drawn as a cubicmap, white pixels are walls like in GenMeshCubicmap
+			const char* layout[] = {
+				"###############",
+				"#.....#.......#",
+				"#.###.#.#####.#",
+				"#.#...#.....#.#",
+				"#.#.#######.#.#",
+				"#.#.........#.#",
+				"#.#####.#####.#",
+				"#.............#",
+				"###.###.###.###",
+				"#.....#.#.....#",
+				"#.###.#.#.###.#",
+				"#...#.....#...#",
+				"###.#######.###",
+				"#.............#",
+				"###############"
+			};
+			int mapSize = (int) (sizeof(layout) / sizeof(layout[0]));
+			Image cubicmap = GenImageColor(mapSize, mapSize, BLACK);
+			for (int z = 0; z < mapSize; z++) {
+				for (int x = 0; x < mapSize; x++) {
+					if (layout[z][x] == '#') {
+						ImageDrawPixel(&cubicmap, x, z, WHITE);
+					}
+				}
+			}
+			VoxelGrid* maze = VoxelGrid::fromCubicmap(&cubicmap, { 1.0f, 1.5f, 1.0f });
+			UnloadImage(cubicmap);
+			// centered on the origin, the camera looks at it from the open side
+			maze->position = geometry::add(maze->position, { -0.5f * (mapSize - 1), 0.0f, -0.5f * (mapSize - 1) });
+			maze->color = { 150, 140, 200, 255 };
+			scene->add(maze);
+
+			PrimitiveGroup<geometry::Cylinder>* ground = new PrimitiveGroup<geometry::Cylinder>();
+			ground->color = { 180, 180, 180, 255 };
+			ground->add(geometry::Cylinder({ 0.0f, -0.1f, 0.0f }, 12.0f, 0.1f));
+			ground->build();
+			scene->add(ground);
+		} else {
+			delete(scene);
+			return NULL;
+		}
+
+		scene->build();
+		return scene;
+	}
+
+	// Moves a scene built by buildScene(name) to its pose at time seconds and refits it.
+	// false for scenes without animation, which are left alone.
+	bool animateScene(const std::string& name, Scene* scene, float time) {
+		if (name == "demo") {
+			// the ring of small spheres orbits the center and bobs
+			PrimitiveGroup<geometry::Sphere>* spheres = (PrimitiveGroup<geometry::Sphere>*) scene->objects[0];
+			for (int i = 0; i < 12; i++) {
+				float angle = (float) i / 12.0f * 2.0f * PI + time * 0.5f;
+				float bob = 0.25f * std::sin(time * 2.0f + (float) i);
+				spheres->primitives[i + 1].center = { std::cos(angle) * 3.5f, 0.35f + std::max(0.0f, bob), std::sin(angle) * 3.5f };
+			}
+		} else {
+			return false;
+		}
+
+		scene->refit();
+		return true;
+	}
+
+};
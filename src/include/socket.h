@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace tracer {
+
+	// Classes //
+	// Blocking stream socket over TCP or a Unix domain socket. Addresses are "host:port"
+	// (host may be empty or * to listen on every interface) or "unix:/path". The platform
+	// code (BSD sockets or Winsock) lives in socket.cpp so windows.h stays out of the
+	// headers, where it clashes with raylib.
+	class Socket {
+		public:
+			~Socket();
+
+			// NULL with the reason printed when the address can not be used
+			static Socket* listen(const std::string& address);
+			static Socket* connect(const std::string& address);
+
+			// NULL when nothing connected within timeoutMs
+			Socket* accept(int timeoutMs);
+			bool sendAll(const void* data, size_t size);
+			// false on an error, on close, or when timeoutMs passes first (negative waits forever)
+			bool receiveAll(void* data, size_t size, int timeoutMs);
+			void close();
+
+		private:
+			intptr_t handle;
+			std::string unixPath;   // a listening Unix socket removes its file on close
+
+			Socket(intptr_t handle, const std::string& unixPath);
+	};
+
+};
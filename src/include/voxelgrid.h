@@ -0,0 +1,297 @@
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include "raylib.h"
+#include "geometry.h"
+#include "scene.h"
+
+namespace tracer {
+
+	// Grid Traversal //
+	// Amanatides-Woo 3D DDA over the cells [lo, hi) of a grid of cellSize cells starting at
+	// gridMin. Visits cells in ray order between tStart and tEnd, cell(x, y, z, tEnter, tExit,
+	// axis) returns true to stop. axis is the one whose face the ray entered the cell through.
+	// Cell indices are always global so nested traversals agree on them.
+	template<typename CellFn>
+	bool traverseGrid(const Ray& ray, Vector3 gridMin, Vector3 cellSize, const int lo[3], const int hi[3], float tStart, float tEnd, CellFn cell) {
+		float origin[3] = { ray.position.x, ray.position.y, ray.position.z };
+		float dir[3] = { ray.direction.x, ray.direction.y, ray.direction.z };
+		float base[3] = { gridMin.x, gridMin.y, gridMin.z };
+		float size[3] = { cellSize.x, cellSize.y, cellSize.z };
+
+		int index[3], step[3];
+		float tNext[3], tDelta[3];
+		for (int axis = 0; axis < 3; axis++) {
+			float p = origin[axis] + dir[axis] * tStart;
+			int i = (int) std::floor((p - base[axis]) / size[axis]);
+			index[axis] = std::max(lo[axis], std::min(hi[axis] - 1, i));
+
+			if (dir[axis] > 0.0f) {
+				step[axis] = 1;
+				tNext[axis] = (base[axis] + (index[axis] + 1) * size[axis] - origin[axis]) / dir[axis];
+				tDelta[axis] = size[axis] / dir[axis];
+			} else if (dir[axis] < 0.0f) {
+				step[axis] = -1;
+				tNext[axis] = (base[axis] + index[axis] * size[axis] - origin[axis]) / dir[axis];
+				tDelta[axis] = -size[axis] / dir[axis];
+			} else {
+				step[axis] = 0;
+				tNext[axis] = FLT_MAX;
+				tDelta[axis] = FLT_MAX;
+			}
+		}
+
+		// the first cell was entered through the face whose slab the ray crossed last
+		int entryAxis = 0;
+		float latest = -FLT_MAX;
+		for (int axis = 0; axis < 3; axis++) {
+			if (step[axis] != 0 && tNext[axis] - tDelta[axis] > latest) {
+				latest = tNext[axis] - tDelta[axis];
+				entryAxis = axis;
+			}
+		}
+
+		float t = tStart;
+		while (t < tEnd) {
+			int axis = (tNext[0] < tNext[1]) ? ((tNext[0] < tNext[2]) ? 0 : 2) : ((tNext[1] < tNext[2]) ? 1 : 2);
+			float tExit = std::min(tNext[axis], tEnd);
+			if (cell(index[0], index[1], index[2], t, tExit, entryAxis)) {
+				return true;
+			}
+			entryAxis = axis;
+
+			index[axis] += step[axis];
+			if (index[axis] < lo[axis] || index[axis] >= hi[axis]) {
+				return false;
+			}
+			t = tExit;
+			tNext[axis] += tDelta[axis];
+		}
+		return false;
+	}
+
+	template<typename CellFn>
+	bool traverseGrid(const Ray& ray, Vector3 gridMin, Vector3 cellSize, int nx, int ny, int nz, float tStart, float tEnd, CellFn cell) {
+		int lo[3] = { 0, 0, 0 };
+		int hi[3] = { nx, ny, nz };
+		return traverseGrid(ray, gridMin, cellSize, lo, hi, tStart, tEnd, cell);
+	}
+
+	// Classes //
+	// Voxel volume with one byte per voxel (0 is empty, anything else solid). An optional
+	// occupancy level of 4x4x4 bricks, one 64-bit mask each, lets the traversal step over
+	// empty bricks and test voxels with a bit lookup.
+	class VoxelGrid : public SceneObject {
+		public:
+			static const int BRICK_SIZE = 4;
+
+			int sizeX, sizeY, sizeZ;
+			Vector3 position;            // min corner of voxel (0, 0, 0)
+			Vector3 voxelSize;
+			std::vector<uint8_t> voxels;
+			bool useBricks;
+			std::vector<uint64_t> bricks;
+
+			VoxelGrid(int sizeX, int sizeY, int sizeZ, Vector3 position, Vector3 voxelSize);
+			~VoxelGrid();
+
+			static VoxelGrid* fromCubicmap(Image* cubicmap, Vector3 cubeSize);
+
+			void toDefault();
+			uint8_t get(int x, int y, int z);
+			void set(int x, int y, int z, uint8_t value);
+			void buildBricks();
+
+			BoundingBox bounds();
+			bool intersect(const Ray& ray, float tMax, geometry::HitRecord* hit);
+			void fillSurface(const Ray& ray, geometry::HitRecord* hit);
+			size_t memoryUsage();
+
+		private:
+			int bricksX();
+			int bricksY();
+			int bricksZ();
+			bool recordHit(int x, int y, int z, float t, int axis, const Ray& ray, geometry::HitRecord* hit);
+	};
+
+	VoxelGrid::VoxelGrid(int sizeX, int sizeY, int sizeZ, Vector3 position, Vector3 voxelSize) {
+		this->toDefault();
+		this->sizeX = sizeX;
+		this->sizeY = sizeY;
+		this->sizeZ = sizeZ;
+		this->position = position;
+		this->voxelSize = voxelSize;
+		this->voxels.assign((size_t) sizeX * sizeY * sizeZ, 0);
+	};
+
+	VoxelGrid::~VoxelGrid() {
+
+	};
+
+	// same placement as GenMeshCubicmap: white pixels become cubes centered on (x * w, h / 2, z * l)
+	VoxelGrid* VoxelGrid::fromCubicmap(Image* cubicmap, Vector3 cubeSize) {
+		Vector3 origin = { -0.5f * cubeSize.x, 0.0f, -0.5f * cubeSize.z };
+		VoxelGrid* grid = new VoxelGrid(cubicmap->width, 1, cubicmap->height, origin, cubeSize);
+
+		Color* pixels = LoadImageColors(*cubicmap);
+		for (int z = 0; z < cubicmap->height; z++) {
+			for (int x = 0; x < cubicmap->width; x++) {
+				Color c = pixels[z * cubicmap->width + x];
+				if (c.r == 255 && c.g == 255 && c.b == 255) {
+					grid->set(x, 0, z, 1);
+				}
+			}
+		}
+		UnloadImageColors(pixels);
+
+		grid->buildBricks();
+		return grid;
+	};
+
+	void VoxelGrid::toDefault() {
+		this->sizeX = 0;
+		this->sizeY = 0;
+		this->sizeZ = 0;
+		this->position = { 0, 0, 0 };
+		this->voxelSize = { 1, 1, 1 };
+		this->voxels.clear();
+		this->useBricks = false;
+		this->bricks.clear();
+	};
+
+	uint8_t VoxelGrid::get(int x, int y, int z) {
+		return this->voxels[((size_t) z * this->sizeY + y) * this->sizeX + x];
+	};
+
+	void VoxelGrid::set(int x, int y, int z, uint8_t value) {
+		this->voxels[((size_t) z * this->sizeY + y) * this->sizeX + x] = value;
+		if (this->useBricks) {
+			size_t b = ((size_t) (z / BRICK_SIZE) * this->bricksY() + y / BRICK_SIZE) * this->bricksX() + x / BRICK_SIZE;
+			uint64_t bit = (uint64_t) 1 << ((x % BRICK_SIZE) + BRICK_SIZE * ((y % BRICK_SIZE) + BRICK_SIZE * (z % BRICK_SIZE)));
+			this->bricks[b] = value ? (this->bricks[b] | bit) : (this->bricks[b] & ~bit);
+		}
+	};
+
+	int VoxelGrid::bricksX() {
+		return (this->sizeX + BRICK_SIZE - 1) / BRICK_SIZE;
+	};
+
+	int VoxelGrid::bricksY() {
+		return (this->sizeY + BRICK_SIZE - 1) / BRICK_SIZE;
+	};
+
+	int VoxelGrid::bricksZ() {
+		return (this->sizeZ + BRICK_SIZE - 1) / BRICK_SIZE;
+	};
+
+	void VoxelGrid::buildBricks() {
+		this->bricks.assign((size_t) this->bricksX() * this->bricksY() * this->bricksZ(), 0);
+		this->useBricks = true;
+		for (int z = 0; z < this->sizeZ; z++) {
+			for (int y = 0; y < this->sizeY; y++) {
+				for (int x = 0; x < this->sizeX; x++) {
+					if (this->get(x, y, z) != 0) {
+						this->set(x, y, z, this->get(x, y, z));
+					}
+				}
+			}
+		}
+	};
+
+	BoundingBox VoxelGrid::bounds() {
+		return {
+			this->position,
+			geometry::add(this->position, geometry::mul(this->voxelSize, geometry::vec3((float) this->sizeX, (float) this->sizeY, (float) this->sizeZ)))
+		};
+	};
+
+	// the normal faces back along the ray on the axis the DDA stepped to reach the voxel.
+	// Voxels entered at or before tMin are skipped, a ray leaving a surface from inside a
+	// solid voxel would hit itself otherwise.
+	bool VoxelGrid::recordHit(int x, int y, int z, float t, int axis, const Ray& ray, geometry::HitRecord* hit) {
+		const float tMin = 1e-4f;
+		if (t <= tMin) {
+			return false;
+		}
+		float sign = geometry::component(ray.direction, axis) > 0.0f ? -1.0f : 1.0f;
+		hit->hit = true;
+		hit->distance = t;
+		hit->u = 0.0f;
+		hit->v = 0.0f;
+		hit->normal = { axis == 0 ? sign : 0.0f, axis == 1 ? sign : 0.0f, axis == 2 ? sign : 0.0f };
+		hit->primitiveId = (z * this->sizeY + y) * this->sizeX + x;
+		return true;
+	};
+
+	bool VoxelGrid::intersect(const Ray& ray, float tMax, geometry::HitRecord* hit) {
+		float tStart;
+		BoundingBox box = this->bounds();
+		Vector3 invDir = geometry::inverseDirection(ray.direction);
+		if (!geometry::intersectBounds(ray, invDir, box, tMax, &tStart)) {
+			return false;
+		}
+
+		float tEnd = tMax;
+		for (int axis = 0; axis < 3; axis++) {
+			float inv = geometry::component(invDir, axis);
+			float ta = (geometry::component(box.min, axis) - geometry::component(ray.position, axis)) * inv;
+			float tb = (geometry::component(box.max, axis) - geometry::component(ray.position, axis)) * inv;
+			if (!std::isnan(ta) && !std::isnan(tb)) {
+				tEnd = std::min(tEnd, std::max(ta, tb));
+			}
+		}
+
+		if (!this->useBricks) {
+			return traverseGrid(ray, this->position, this->voxelSize, this->sizeX, this->sizeY, this->sizeZ, tStart, tEnd,
+				[&](int x, int y, int z, float tEnter, float, int axis) {
+					return this->get(x, y, z) != 0 && this->recordHit(x, y, z, tEnter, axis, ray, hit);
+				});
+		}
+
+		Vector3 brickSize = geometry::mul(this->voxelSize, (float) BRICK_SIZE);
+		return traverseGrid(ray, this->position, brickSize, this->bricksX(), this->bricksY(), this->bricksZ(), tStart, tEnd,
+			[&](int bx, int by, int bz, float brickEnter, float brickExit, int) {
+				uint64_t mask = this->bricks[((size_t) bz * this->bricksY() + by) * this->bricksX() + bx];
+				if (mask == 0) {
+					return false;
+				}
+
+				int lo[3] = { bx * BRICK_SIZE, by * BRICK_SIZE, bz * BRICK_SIZE };
+				int hi[3] = {
+					std::min(lo[0] + BRICK_SIZE, this->sizeX),
+					std::min(lo[1] + BRICK_SIZE, this->sizeY),
+					std::min(lo[2] + BRICK_SIZE, this->sizeZ)
+				};
+
+				return traverseGrid(ray, this->position, this->voxelSize, lo, hi, brickEnter, brickExit,
+					[&](int x, int y, int z, float tEnter, float, int axis) {
+						uint64_t bit = (uint64_t) 1 << ((x - lo[0]) + BRICK_SIZE * ((y - lo[1]) + BRICK_SIZE * (z - lo[2])));
+						return (mask & bit) != 0 && this->recordHit(x, y, z, tEnter, axis, ray, hit);
+					});
+			});
+	};
+
+	void VoxelGrid::fillSurface(const Ray& ray, geometry::HitRecord* hit) {
+		int x = hit->primitiveId % this->sizeX;
+		int y = (hit->primitiveId / this->sizeX) % this->sizeY;
+		int z = hit->primitiveId / (this->sizeX * this->sizeY);
+		hit->point = geometry::rayAt(ray, hit->distance);
+
+		// recordHit already set the normal of the face the ray entered through
+		Vector3 local = geometry::sub(hit->point, this->position);
+		float f[3] = {
+			local.x / this->voxelSize.x - (float) x,
+			local.y / this->voxelSize.y - (float) y,
+			local.z / this->voxelSize.z - (float) z
+		};
+		int bestAxis = hit->normal.x != 0.0f ? 0 : hit->normal.y != 0.0f ? 1 : 2;
+		hit->uv = (bestAxis == 0) ? Vector2{ f[2], f[1] } : (bestAxis == 1) ? Vector2{ f[0], f[2] } : Vector2{ f[0], f[1] };
+	};
+
+	size_t VoxelGrid::memoryUsage() {
+		return this->voxels.size() + this->bricks.size() * sizeof(uint64_t);
+	};
+
+};
@@ -1,51 +1,455 @@
-
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
 #include <iostream>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include "include/raylib.h"
 #include "include/mathlib.h"
 #include "include/stringlib.h"
 #include "include/image_buffer.h"
+#include "include/scenes.h"
+#include "include/renderer.h"
+#include "include/picking.h"
+#include "include/options.h"
+#include "include/animation.h"
+#include "include/distributed.h"
+
+mathlib::CFrame* default_camera() {
+	return new mathlib::CFrame(new mathlib::Vector3f(0.0f, 3.0f, 9.0f), new mathlib::Vector3f(0.0f, 1.0f, 0.0f));
+}
+
+// Batch mode for machines without a display: no window, no GL context, no textures.
+// Renders until every pixel has its samples (or converged under the threshold) and writes the image.
+int run_headless(const tracer::RenderOptions& options) {
+	tracer::Scene* scene = tracer::buildScene(options.scene);
+	if (scene == NULL) {
+		std::cerr << "unknown scene " << options.scene << std::endl;
+		return 1;
+	}
+	std::cout << "scene " << options.scene << ": " << ((scene->memoryUsage() + 1023) >> 10) << " KB of geometry" << std::endl;
+
+	tracer::TileRenderer* renderer = new tracer::TileRenderer(scene, NULL);
+	mathlib::CFrame* cameraCFrame = default_camera();
+	renderer->camera.setCFrame(cameraCFrame);
+	delete(cameraCFrame);
+	renderer->maxSamples = options.samples;
+	renderer->minSamples = std::min(renderer->minSamples, options.samples);
+	renderer->errorThreshold = options.threshold;
+	renderer->seed = options.seed;
+	renderer->sampler = tracer::createSampler(options.sampler, options.seed);
 
-const int SCREEN_WIDTH = 800;
-const int SCREEN_HEIGHT = 800;
+	// .ppm, .pfm and .tlf are streamed band by band, so the image is never held whole
+	tracer::ImageWriter* writer = tracer::createImageWriter(options.output);
+	if (writer != NULL && !options.checkpoint.empty()) {
+		std::cerr << "--checkpoint needs a progressive render, streamed outputs (.ppm, .pfm, .tlf) are written as they go" << std::endl;
+		delete(writer);
+		delete(renderer);
+		delete(scene);
+		return 1;
+	}
+	if (writer != NULL) {
+		tracer::BandFilter* filter = tracer::createBandFilter(options.filter);
+		renderer->filter = filter;
+		renderer->memoryBudget = (size_t) options.memory << 20;
+		bool written = writer->open(options.output, options.width, options.height)
+			&& renderer->renderStreamed(writer, options.width, options.height);
+		written = writer->close() && written;
+		if (written) {
+			std::cout << "wrote " << options.output << " (" << options.width << "x" << options.height << ", "
+				<< renderer->stats.totalSamples << " samples in " << renderer->stats.wallSeconds << " s, "
+				<< (renderer->stats.streamedBytes >> 10) << " KB of bands)" << std::endl;
+		} else {
+			std::cerr << "could not write " << options.output << std::endl;
+		}
+		delete(writer);
+		delete(filter);
+		delete(renderer);
+		delete(scene);
+		return written ? 0 : 1;
+	}
+	if (options.memory > 0 || options.filter != "none") {
+		std::cerr << "--memory and --filter need a streamed output (.ppm, .pfm or .tlf)" << std::endl;
+		delete(renderer);
+		delete(scene);
+		return 1;
+	}
+	if (!options.checkpoint.empty()) {
+		renderer->checkpointSeconds = options.checkpointSeconds;
+		if (!renderer->openCheckpoint(options.checkpoint, options.width, options.height, options.scene)) {
+			delete(renderer);
+			delete(scene);
+			return 1;
+		}
+	}
+
+	bufferNamespace::ImageDisplayBuffer* imgDisplayBuffer = new bufferNamespace::ImageDisplayBuffer();
+	Image blank = GenImageColor(options.width, options.height, BLACK);
+	imgDisplayBuffer->SetImage(&blank);
+	UnloadImage(blank);
+	if (renderer->accumulation.passes > 0) {
+		std::cout << "resuming " << options.checkpoint << " at pass " << renderer->accumulation.passes << std::endl;
+		renderer->redraw(imgDisplayBuffer);
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	auto lastStats = start;
+	while (renderer->render(imgDisplayBuffer)) {
+		auto now = std::chrono::steady_clock::now();
+		if (std::chrono::duration<double>(now - lastStats).count() > 1.0) {
+			std::string* stats = renderer->statsString();
+			std::cout << *stats << std::endl;
+			delete(stats);
+			lastStats = now;
+		}
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	imgDisplayBuffer->Acquire();
+	bool written = ExportImage(*imgDisplayBuffer->GetActive(), options.output.c_str());
+	if (written) {
+		std::cout << "wrote " << options.output << " (" << options.width << "x" << options.height << ", "
+			<< renderer->stats.totalSamples << " samples in " << seconds << " s)" << std::endl;
+		if (renderer->checkpoint != NULL) {
+			renderer->checkpoint->remove();
+		}
+	} else {
+		std::cerr << "could not write " << options.output << std::endl;
+	}
+
+	delete(renderer);
+	delete(imgDisplayBuffer);
+	delete(scene);
+	return written ? 0 : 1;
+}
+
+// Headless animation: frame n + 1 is set up and frame n - 1 written while frame n traces.
+int run_sequence(const tracer::RenderOptions& options) {
+	std::string pattern = tracer::framePattern(options.output);
+	if (!tracer::isFramePattern(pattern)) {
+		std::cerr << "--output " << options.output << " needs exactly one %d (or %04d) for the frame number and no other %" << std::endl;
+		return 1;
+	}
+	tracer::Scene* scenes[2] = { tracer::buildScene(options.scene), tracer::buildScene(options.scene) };
+	if (scenes[0] == NULL) {
+		std::cerr << "unknown scene " << options.scene << std::endl;
+		return 1;
+	}
+
+	float framesPerSecond = 24.0f;
+	tracer::CameraPath* path = NULL;
+	if (options.path.empty()) {
+		// one turn around the scene over the whole sequence
+		path = tracer::orbitPath({ 0.0f, 1.0f, 0.0f }, 9.0f, 2.0f, options.frames / framesPerSecond);
+	} else {
+		path = new tracer::CameraPath();
+		if (!path->load(options.path)) {
+			delete(path);
+			delete(scenes[0]);
+			delete(scenes[1]);
+			return 1;
+		}
+	}
+
+	tracer::TileRenderer* renderer = new tracer::TileRenderer(scenes[0], NULL);
+	renderer->maxSamples = options.samples;
+	renderer->minSamples = std::min(renderer->minSamples, options.samples);
+	renderer->errorThreshold = options.threshold;
+	renderer->seed = options.seed;
+	renderer->sampler = tracer::createSampler(options.sampler, options.seed);
+
+	tracer::SequenceRenderer* sequence = new tracer::SequenceRenderer(renderer, path, scenes[0], scenes[1]);
+	sequence->framesPerSecond = framesPerSecond;
+	std::string sceneName = options.scene;
+	sequence->animate = [sceneName](tracer::Scene* scene, float time) {
+		tracer::animateScene(sceneName, scene, time);
+	};
+
+	bool written = sequence->render(options.frames, options.width, options.height, pattern);
+	const tracer::SequenceStats& stats = sequence->stats;
+	std::cout << "rendered " << stats.frames << " frames to " << pattern << " in " << stats.wallSeconds << " s: trace "
+		<< stats.traceSeconds << " s, setup " << stats.setupSeconds << " s and write " << stats.writeSeconds << " s overlapped" << std::endl;
+
+	delete(sequence);
+	delete(renderer);
+	delete(path);
+	delete(scenes[0]);
+	delete(scenes[1]);
+	return written ? 0 : 1;
+}
+
+// One range of sample indices for every pixel, written as exact sums so ranges rendered
+// anywhere can be merged into the image a single render of all of them would give.
+int run_partial(const tracer::RenderOptions& options) {
+	tracer::Scene* scene = tracer::buildScene(options.scene);
+	if (scene == NULL) {
+		std::cerr << "unknown scene " << options.scene << std::endl;
+		return 1;
+	}
+
+	tracer::TileRenderer* renderer = new tracer::TileRenderer(scene, NULL);
+	mathlib::CFrame* cameraCFrame = default_camera();
+	renderer->camera.setCFrame(cameraCFrame);
+	delete(cameraCFrame);
+	renderer->seed = options.seed;
+	renderer->sampler = tracer::createSampler(options.sampler, options.seed);
+
+	tracer::PartialImage* partial = new tracer::PartialImage();
+	unsigned long long key = tracer::hashBytes(options.scene.data(), options.scene.size(), renderer->sampleKey(options.width, options.height));
+	partial->reset(options.width, options.height, options.firstSample, options.lastSample, key);
+	auto start = std::chrono::steady_clock::now();
+	renderer->renderRange(partial);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	bool written = partial->save(options.output);
+	if (written) {
+		std::cout << "wrote samples " << options.firstSample << ":" << options.lastSample << " to " << options.output << " ("
+			<< renderer->stats.totalSamples << " samples in " << seconds << " s)" << std::endl;
+	} else {
+		std::cerr << "could not write " << options.output << std::endl;
+	}
+
+	delete(partial);
+	delete(renderer);
+	delete(scene);
+	return written ? 0 : 1;
+}
+
+int run_merge(const tracer::RenderOptions& options) {
+	std::vector<tracer::PartialImage*> partials;
+	bool loaded = true;
+	size_t start = 0;
+	while (start <= options.merge.size()) {
+		size_t comma = std::min(options.merge.find(',', start), options.merge.size());
+		tracer::PartialImage* partial = new tracer::PartialImage();
+		partials.push_back(partial);
+		loaded = loaded && partial->load(options.merge.substr(start, comma - start));
+		start = comma + 1;
+	}
 
-void run_app() {
-	InitWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "Particle Simulation");
+	// ranges can come in any order, they merge in sample order
+	bool merged = loaded;
+	if (merged) {
+		std::sort(partials.begin(), partials.end(), [](tracer::PartialImage* a, tracer::PartialImage* b) {
+			return a->firstSample < b->firstSample;
+		});
+		for (size_t i = 1; i < partials.size() && merged; i++) {
+			merged = partials[0]->merge(*partials[i]);
+		}
+	}
+	bool written = false;
+	if (merged) {
+		tracer::PartialImage* total = partials[0];
+		std::vector<Vector3> pixels((size_t) total->width * total->height);
+		total->resolve(pixels.data());
+		written = tracer::saveImage(options.output, pixels.data(), total->width, total->height);
+		if (written) {
+			std::cout << "wrote " << options.output << " from samples " << total->firstSample << ":" << total->lastSample
+				<< " of " << partials.size() << " partial renders" << std::endl;
+		} else {
+			std::cerr << "could not write " << options.output << std::endl;
+		}
+	}
+
+	for (tracer::PartialImage* partial : partials) {
+		delete(partial);
+	}
+	return written ? 0 : 1;
+}
+
+// Hands the frame out in tiles to worker processes, which may run on other machines,
+// and writes the image once every tile is back.
+int run_coordinator(const tracer::RenderOptions& options) {
+	if (!tracer::isScene(options.scene)) {
+		std::cerr << "unknown scene " << options.scene << std::endl;
+		return 1;
+	}
+	tracer::Socket* listener = tracer::Socket::listen(options.coordinator);
+	if (listener == NULL) {
+		return 1;
+	}
+
+	// nothing is traced here, the workers build the scene from its name
+	tracer::RenderCamera camera;
+	mathlib::CFrame* cameraCFrame = default_camera();
+	camera.setCFrame(cameraCFrame);
+	delete(cameraCFrame);
+	tracer::RenderJobHeader job = tracer::makeRenderJob(options, camera);
+
+	std::cout << "waiting for workers on " << options.coordinator << std::endl;
+	tracer::Coordinator* coordinator = new tracer::Coordinator(listener);
+	coordinator->tileTimeout = options.tileTimeout;
+	std::vector<Vector3> pixels((size_t) options.width * options.height);
+	coordinator->render(job, pixels.data());
+
+	long long samples = 0;
+	for (size_t i = 0; i < coordinator->workers.size(); i++) {
+		const tracer::WorkerStats& worker = coordinator->workers[i];
+		if (worker.tiles == 0 && !worker.lost) {
+			continue;   // reconnected after its last tile was taken
+		}
+		std::cout << "worker " << i << ": " << worker.tiles << " tiles, " << worker.samples << " samples" << (worker.lost ? ", lost" : "") << std::endl;
+		samples += worker.samples;
+	}
+	bool written = tracer::saveImage(options.output, pixels.data(), options.width, options.height);
+	if (written) {
+		std::cout << "wrote " << options.output << " (" << options.width << "x" << options.height << ", "
+			<< samples << " samples in " << coordinator->wallSeconds << " s)" << std::endl;
+	} else {
+		std::cerr << "could not write " << options.output << std::endl;
+	}
+
+	delete(coordinator);
+	delete(listener);
+	return written ? 0 : 1;
+}
+
+int run_worker(const tracer::RenderOptions& options) {
+	tracer::Worker* worker = new tracer::Worker();
+	bool reached = worker->run(options.worker);
+	if (reached) {
+		std::cout << "rendered " << worker->tilesRendered << " tiles for " << options.worker << std::endl;
+	} else {
+		std::cerr << "no coordinator at " << options.worker << std::endl;
+	}
+	delete(worker);
+	return reached ? 0 : 1;
+}
+
+void run_app(const tracer::RenderOptions& options) {
+	tracer::Scene* scene = tracer::buildScene(options.scene);
+	if (scene == NULL) {
+		std::cerr << "unknown scene " << options.scene << std::endl;
+		return;
+	}
+
+	InitWindow(options.width, options.height, "Particle Simulation");
 	SetTargetFPS(60);
 
 	bufferNamespace::ImageDisplayBuffer* imgDisplayBuffer = new bufferNamespace::ImageDisplayBuffer();
 
-	Image blank1 = GenImageWhiteNoise(SCREEN_WIDTH, SCREEN_HEIGHT, 0.5);
-	imgDisplayBuffer->buffer1 = blank1;
-	Image blank2 = GenImageCellular(SCREEN_WIDTH, SCREEN_HEIGHT, 2);
-	imgDisplayBuffer->buffer2 = blank2;
+	Image blank = GenImageColor(options.width, options.height, BLACK);
+	imgDisplayBuffer->SetImage(&blank);
+	UnloadImage(blank);
+
+	tracer::TileRenderer* renderer = new tracer::TileRenderer(scene, NULL);
+	mathlib::CFrame* cameraCFrame = default_camera();
+	renderer->camera.setCFrame(cameraCFrame);
+	delete(cameraCFrame);
+	renderer->seed = options.seed;
+	renderer->sampler = tracer::createSampler(options.sampler, options.seed);
+	renderer->frameBudget = 0.014; // keeps a fresh frame within reach of the 60 fps display loop
+	tracer::ResolutionController* resolution = new tracer::ResolutionController(1.0 / 30.0); // full pass time
+	renderer->resolution = resolution;
 
-	imgDisplayBuffer->Flip(); // force flip to load texture for below
+	// mouse wheel zooms, middle drag pans and alt + middle drag orbits. The window loop
+	// hands each moved camera over and the render thread takes it between render calls,
+	// where a change restarts the accumulation from the reprojected history.
+	Camera camera = renderer->camera.toCamera();
+	SetCameraMode(camera, CAMERA_FREE);
+	std::mutex cameraLock;
+	Camera movedCamera = camera;
+	bool cameraMoved = false;
+
+	// the renderer runs flat out on its own thread and publishes frames through the
+	// triple buffer, the window loop below only ever picks up the newest one
+	std::atomic<bool> rendering(true);
+	std::thread renderThread([&]() {
+		auto lastStats = std::chrono::steady_clock::now();
+		while (rendering.load()) {
+			{
+				std::lock_guard<std::mutex> lock(cameraLock);
+				if (cameraMoved) {
+					renderer->camera.setCamera(movedCamera);
+					cameraMoved = false;
+				}
+			}
+			if (!renderer->render(imgDisplayBuffer)) {
+				// every tile has converged, nothing to do until the camera or scene changes
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+				continue;
+			}
+
+			auto now = std::chrono::steady_clock::now();
+			if (std::chrono::duration<double>(now - lastStats).count() > 1.0) {
+				std::string* stats = renderer->statsString();
+				std::cout << *stats << std::endl;
+				delete(stats);
+				lastStats = now;
+			}
+		}
+	});
 
-	std::clock_t last_lock = std::clock();
 	while (!WindowShouldClose()) {
-		std::clock_t new_clock = std::clock();
-		float delta = (new_clock - last_lock) * 1e-3;
-		if (delta > 1) {
-			std::cout << "flip - " << imgDisplayBuffer->bufferState << std::endl;
-			imgDisplayBuffer->Flip();
-			last_lock = new_clock;;
-		}
-		
-		// check update status (if not updating, start updating)
+		Camera previous = camera;
+		UpdateCamera(&camera);
+		if (std::memcmp(&previous, &camera, sizeof(Camera)) != 0) {
+			std::lock_guard<std::mutex> lock(cameraLock);
+			movedCamera = camera;
+			cameraMoved = true;
+		}
+
+		if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) {
+			// the scene is only read while the app runs, so picking can share it with the render thread
+			tracer::PickResult picked = tracer::pick(scene, camera, GetMousePosition(), NULL);
+			if (picked.hit) {
+				std::cout << "picked object " << picked.objectId << ", primitive " << picked.triangle << " at distance " << picked.distance
+					<< " (" << picked.point.x << ", " << picked.point.y << ", " << picked.point.z << ")" << std::endl;
+			} else {
+				std::cout << "picked nothing" << std::endl;
+			}
+		}
+
+		imgDisplayBuffer->Present();
+
 		BeginDrawing();
 			ClearBackground(BLACK);
-			DrawTexture(imgDisplayBuffer->activeTexture, 0, 0, WHITE);
-			// display active buffer image
+			if (imgDisplayBuffer->activeTexture.id != 0) {
+				// display active buffer image
+				DrawTexture(imgDisplayBuffer->activeTexture, 0, 0, WHITE);
+			}
 		EndDrawing();
 	}
+
+	rendering.store(false);
+	renderThread.join();
+
+	delete(imgDisplayBuffer); // owns a texture, so it goes before the window
 	CloseWindow();
 
-	delete(imgDisplayBuffer);
+	delete(renderer);
+	delete(resolution);
+	delete(scene);
 
 }
 
-int main() {
-	run_app();
+int main(int argc, char** argv) {
+	tracer::RenderOptions options;
+	if (!tracer::parseOptions(argc, argv, &options)) {
+		tracer::printUsage(argv[0]);
+		return 1;
+	}
+	if (options.threads > 0) {
+		jobs::initShared(options.threads - 1); // the calling thread is the last one
+	}
+
+	if (!options.worker.empty()) {
+		return run_worker(options);
+	}
+	if (!options.coordinator.empty()) {
+		return run_coordinator(options);
+	}
+	if (!options.merge.empty()) {
+		return run_merge(options);
+	}
+	if (options.lastSample > 0) {
+		return run_partial(options);
+	}
+	if (options.headless) {
+		return options.frames > 0 ? run_sequence(options) : run_headless(options);
+	}
+	run_app(options);
 	return 0;
 }
@@ -0,0 +1,142 @@
+#include <iostream>
+#include "include/mapped_file.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace tracer {
+
+	MappedFile::MappedFile() {
+		this->base = NULL;
+		this->length = 0;
+		this->file = -1;
+		this->mapping = 0;
+	};
+
+	MappedFile::~MappedFile() {
+		this->close();
+	};
+
+	unsigned char* MappedFile::data() {
+		return this->base;
+	};
+
+	size_t MappedFile::size() {
+		return this->length;
+	};
+
+	bool MappedFile::isOpen() {
+		return this->base != NULL;
+	};
+
+#ifdef _WIN32
+	bool MappedFile::open(const std::string& path, size_t size, bool* existing) {
+		this->close();
+		HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (handle == INVALID_HANDLE_VALUE) {
+			std::cerr << "could not open " << path << " (error " << GetLastError() << ")" << std::endl;
+			return false;
+		}
+		LARGE_INTEGER current;
+		GetFileSizeEx(handle, &current);
+		*existing = (unsigned long long) current.QuadPart == (unsigned long long) size;
+
+		LARGE_INTEGER wanted;
+		wanted.QuadPart = (LONGLONG) size;
+		if (!*existing && (!SetFilePointerEx(handle, wanted, NULL, FILE_BEGIN) || !SetEndOfFile(handle))) {
+			std::cerr << "could not size " << path << " to " << size << " bytes (error " << GetLastError() << ")" << std::endl;
+			CloseHandle(handle);
+			return false;
+		}
+		HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_READWRITE, (DWORD) ((unsigned long long) size >> 32), (DWORD) (size & 0xffffffffu), NULL);
+		void* view = mapping != NULL ? MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size) : NULL;
+		if (view == NULL) {
+			std::cerr << "could not map " << path << " (error " << GetLastError() << ")" << std::endl;
+			if (mapping != NULL) {
+				CloseHandle(mapping);
+			}
+			CloseHandle(handle);
+			return false;
+		}
+		this->base = (unsigned char*) view;
+		this->length = size;
+		this->file = (intptr_t) handle;
+		this->mapping = (intptr_t) mapping;
+		return true;
+	};
+
+	void MappedFile::close() {
+		if (this->base != NULL) {
+			UnmapViewOfFile(this->base);
+			CloseHandle((HANDLE) this->mapping);
+			CloseHandle((HANDLE) this->file);
+		}
+		this->base = NULL;
+		this->length = 0;
+		this->file = -1;
+		this->mapping = 0;
+	};
+
+	bool MappedFile::flush(size_t offset, size_t length) {
+		if (this->base == NULL) {
+			return false;
+		}
+		return FlushViewOfFile(this->base + offset, length) && FlushFileBuffers((HANDLE) this->file);
+	};
+#else
+	bool MappedFile::open(const std::string& path, size_t size, bool* existing) {
+		this->close();
+		int descriptor = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+		if (descriptor < 0) {
+			std::cerr << "could not open " << path << std::endl;
+			return false;
+		}
+		struct stat info;
+		*existing = fstat(descriptor, &info) == 0 && (size_t) info.st_size == size;
+		if (!*existing && ftruncate(descriptor, (off_t) size) != 0) {
+			std::cerr << "could not size " << path << " to " << size << " bytes" << std::endl;
+			::close(descriptor);
+			return false;
+		}
+		void* view = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+		if (view == MAP_FAILED) {
+			std::cerr << "could not map " << path << std::endl;
+			::close(descriptor);
+			return false;
+		}
+		this->base = (unsigned char*) view;
+		this->length = size;
+		this->file = descriptor;
+		return true;
+	};
+
+	void MappedFile::close() {
+		if (this->base != NULL) {
+			munmap(this->base, this->length);
+			::close((int) this->file);
+		}
+		this->base = NULL;
+		this->length = 0;
+		this->file = -1;
+		this->mapping = 0;
+	};
+
+	bool MappedFile::flush(size_t offset, size_t length) {
+		if (this->base == NULL) {
+			return false;
+		}
+		// msync wants a page aligned start
+		size_t page = (size_t) sysconf(_SC_PAGESIZE);
+		size_t start = offset / page * page;
+		return msync(this->base + start, length + (offset - start), MS_SYNC) == 0;
+	};
+#endif
+
+};
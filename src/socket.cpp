@@ -0,0 +1,264 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include "include/socket.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+#include <afunix.h>
+typedef SOCKET NativeSocket;
+typedef int SocketLength;
+typedef WSAPOLLFD PollEntry;
+static const NativeSocket NO_SOCKET = INVALID_SOCKET;
+#define pollSockets WSAPoll
+#define closeSocket closesocket
+#else
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+typedef int NativeSocket;
+typedef socklen_t SocketLength;
+typedef pollfd PollEntry;
+static const NativeSocket NO_SOCKET = -1;
+#define pollSockets poll
+#define closeSocket ::close
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace tracer {
+
+	// Winsock has to be started once per process before any other call
+	static bool startSockets() {
+#ifdef _WIN32
+		static bool started = false;
+		if (!started) {
+			WSADATA data;
+			started = WSAStartup(MAKEWORD(2, 2), &data) == 0;
+		}
+		return started;
+#else
+		return true;
+#endif
+	}
+
+	// fills addr for "unix:/path", false when the path does not fit
+	static bool unixAddress(const std::string& address, sockaddr_un* addr) {
+		std::string path = address.substr(5);
+		std::memset(addr, 0, sizeof(sockaddr_un));
+		addr->sun_family = AF_UNIX;
+		if (path.empty() || path.size() >= sizeof(addr->sun_path)) {
+			std::cerr << "bad unix socket path " << path << std::endl;
+			return false;
+		}
+		std::memcpy(addr->sun_path, path.c_str(), path.size());
+		return true;
+	}
+
+	static addrinfo* tcpAddress(const std::string& address, bool passive) {
+		size_t colon = address.find_last_of(':');
+		if (colon == std::string::npos) {
+			std::cerr << "bad address " << address << ", expected host:port or unix:/path" << std::endl;
+			return NULL;
+		}
+		std::string host = address.substr(0, colon);
+		std::string port = address.substr(colon + 1);
+		addrinfo hints;
+		std::memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_flags = passive ? AI_PASSIVE : 0;
+		addrinfo* found = NULL;
+		const char* node = host.empty() || host == "*" ? NULL : host.c_str();
+		if (getaddrinfo(node, port.c_str(), &hints, &found) != 0) {
+			std::cerr << "could not resolve " << address << std::endl;
+			return NULL;
+		}
+		return found;
+	}
+
+	static void tuneConnection(NativeSocket handle) {
+		int on = 1;
+		setsockopt(handle, IPPROTO_TCP, TCP_NODELAY, (const char*) &on, sizeof(on)); // fails harmlessly on Unix sockets
+	}
+
+	Socket::Socket(intptr_t handle, const std::string& unixPath) {
+		this->handle = handle;
+		this->unixPath = unixPath;
+	};
+
+	Socket::~Socket() {
+		this->close();
+	};
+
+	void Socket::close() {
+		if ((NativeSocket) this->handle != NO_SOCKET) {
+			closeSocket((NativeSocket) this->handle);
+			if (!this->unixPath.empty()) {
+				std::remove(this->unixPath.c_str());
+			}
+		}
+		this->handle = (intptr_t) NO_SOCKET;
+	};
+
+	Socket* Socket::listen(const std::string& address) {
+		if (!startSockets()) {
+			return NULL;
+		}
+		if (address.compare(0, 5, "unix:") == 0) {
+			sockaddr_un addr;
+			if (!unixAddress(address, &addr)) {
+				return NULL;
+			}
+			NativeSocket handle = socket(AF_UNIX, SOCK_STREAM, 0);
+			std::remove(addr.sun_path); // left behind by a coordinator that was killed
+			if (handle == NO_SOCKET || bind(handle, (sockaddr*) &addr, sizeof(addr)) != 0 || ::listen(handle, 64) != 0) {
+				std::cerr << "could not listen on " << address << std::endl;
+				if (handle != NO_SOCKET) {
+					closeSocket(handle);
+				}
+				return NULL;
+			}
+			return new Socket((intptr_t) handle, addr.sun_path);
+		}
+
+		addrinfo* found = tcpAddress(address, true);
+		if (found == NULL) {
+			return NULL;
+		}
+		NativeSocket handle = NO_SOCKET;
+		for (addrinfo* option = found; option != NULL; option = option->ai_next) {
+			handle = socket(option->ai_family, option->ai_socktype, option->ai_protocol);
+			if (handle == NO_SOCKET) {
+				continue;
+			}
+			int on = 1;
+			setsockopt(handle, SOL_SOCKET, SO_REUSEADDR, (const char*) &on, sizeof(on));
+			if (bind(handle, option->ai_addr, (SocketLength) option->ai_addrlen) == 0 && ::listen(handle, 64) == 0) {
+				break;
+			}
+			closeSocket(handle);
+			handle = NO_SOCKET;
+		}
+		freeaddrinfo(found);
+		if (handle == NO_SOCKET) {
+			std::cerr << "could not listen on " << address << std::endl;
+			return NULL;
+		}
+		return new Socket((intptr_t) handle, "");
+	};
+
+	Socket* Socket::connect(const std::string& address) {
+		if (!startSockets()) {
+			return NULL;
+		}
+		if (address.compare(0, 5, "unix:") == 0) {
+			sockaddr_un addr;
+			if (!unixAddress(address, &addr)) {
+				return NULL;
+			}
+			NativeSocket handle = socket(AF_UNIX, SOCK_STREAM, 0);
+			if (handle == NO_SOCKET || ::connect(handle, (sockaddr*) &addr, sizeof(addr)) != 0) {
+				if (handle != NO_SOCKET) {
+					closeSocket(handle);
+				}
+				return NULL;
+			}
+			return new Socket((intptr_t) handle, "");
+		}
+
+		addrinfo* found = tcpAddress(address, false);
+		if (found == NULL) {
+			return NULL;
+		}
+		NativeSocket handle = NO_SOCKET;
+		for (addrinfo* option = found; option != NULL; option = option->ai_next) {
+			handle = socket(option->ai_family, option->ai_socktype, option->ai_protocol);
+			if (handle == NO_SOCKET) {
+				continue;
+			}
+			if (::connect(handle, option->ai_addr, (SocketLength) option->ai_addrlen) == 0) {
+				break;
+			}
+			closeSocket(handle);
+			handle = NO_SOCKET;
+		}
+		freeaddrinfo(found);
+		if (handle == NO_SOCKET) {
+			return NULL;
+		}
+		tuneConnection(handle);
+		return new Socket((intptr_t) handle, "");
+	};
+
+	Socket* Socket::accept(int timeoutMs) {
+		PollEntry entry;
+		entry.fd = (NativeSocket) this->handle;
+		entry.events = POLLIN;
+		entry.revents = 0;
+		if (pollSockets(&entry, 1, timeoutMs) <= 0) {
+			return NULL;
+		}
+		NativeSocket client = ::accept((NativeSocket) this->handle, NULL, NULL);
+		if (client == NO_SOCKET) {
+			return NULL;
+		}
+		tuneConnection(client);
+		return new Socket((intptr_t) client, "");
+	};
+
+	bool Socket::sendAll(const void* data, size_t size) {
+		const char* bytes = (const char*) data;
+		while (size > 0) {
+			int chunk = (int) std::min(size, (size_t) 1 << 20);
+			int sent = (int) send((NativeSocket) this->handle, bytes, chunk, MSG_NOSIGNAL);
+			if (sent <= 0) {
+				return false;
+			}
+			bytes += sent;
+			size -= (size_t) sent;
+		}
+		return true;
+	};
+
+	bool Socket::receiveAll(void* data, size_t size, int timeoutMs) {
+		char* bytes = (char*) data;
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs < 0 ? 0 : timeoutMs);
+		while (size > 0) {
+			int wait = -1;
+			if (timeoutMs >= 0) {
+				wait = (int) std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+				if (wait <= 0) {
+					return false;
+				}
+			}
+			PollEntry entry;
+			entry.fd = (NativeSocket) this->handle;
+			entry.events = POLLIN;
+			entry.revents = 0;
+			if (pollSockets(&entry, 1, wait) <= 0) {
+				return false;
+			}
+			int chunk = (int) std::min(size, (size_t) 1 << 20);
+			int received = (int) recv((NativeSocket) this->handle, bytes, chunk, 0);
+			if (received <= 0) {
+				return false;
+			}
+			bytes += received;
+			size -= (size_t) received;
+		}
+		return true;
+	};
+
+};
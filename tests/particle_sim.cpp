@@ -2,11 +2,10 @@
 #include <iostream>
 #include <vector>
 #include <ctime>
-#include <random>
-#include <thread>
 #include "include/raylib.h"
 #include "include/mathlib.h"
 #include "include/stringlib.h"
+#include "include/jobs.h"
 
 const int SCREEN_WIDTH = 800;
 const int SCREEN_HEIGHT = 600;
@@ -21,7 +20,7 @@ class Particle  {
 		Particle();
 		~Particle();
 		void toDefault();
-		void randomize();
+		void randomize(const float* uniforms);
 		void step(float delta);
 		void wrap_bounds();
 		std::string* toString();
@@ -44,19 +43,20 @@ void Particle::toDefault() {
 	this->radius = 3;
 };
 
-void Particle::randomize() {
-	this->x = mathlib::randomInt(50, SCREEN_WIDTH - 50);
-	this->y = mathlib::randomInt(50, SCREEN_HEIGHT - 50);
-	
-	mathlib::Vector2f* dir = new mathlib::Vector2f(mathlib::randomInt(0, 300) - 150, mathlib::randomInt(0, 300) - 150);
+// uniforms holds 6 values in [0, 1)
+void Particle::randomize(const float* uniforms) {
+	this->x = std::floor(50 + uniforms[0] * (SCREEN_WIDTH - 100));
+	this->y = std::floor(50 + uniforms[1] * (SCREEN_HEIGHT - 100));
+
+	mathlib::Vector2f* dir = new mathlib::Vector2f(std::floor(uniforms[2] * 300) - 150, std::floor(uniforms[3] * 300) - 150);
 	mathlib::Vector2f* unit_dir = dir->unit();
 	delete(dir);
 	this->dx = unit_dir->x;
 	this->dy = unit_dir->y;
 	delete(unit_dir);
 
-	this->speed = mathlib::randomInt(5, 25);
-	this->radius = mathlib::randomInt(2, 5);
+	this->speed = std::floor(5 + uniforms[4] * 20);
+	this->radius = std::floor(2 + uniforms[5] * 3);
 };
 
 void Particle::step(float delta) {
@@ -102,16 +102,12 @@ void _update_particle(Particle* particle, float delta) {
 }
 
 void update_particles_parallel(std::vector<Particle*>* particles, float delta) {
-	std::vector<std::thread*>* threads = new std::vector<std::thread*>( particles->size() );
-
-	for (unsigned int i = 0; i < particles->size(); i++) {
-		std::thread* thread = new std::thread(_update_particle, particles->data()[i], delta);
-		threads->data()[i] = thread;
-	}
-
-	for (std::thread* threadd : *threads) {
-		threadd->join();
-	}
+	// batches of particles per job, a single particle is far too little work to hand out
+	jobs::shared()->parallelFor(0, (int) particles->size(), 256, [particles, delta](int start, int stop) {
+		for (int i = start; i < stop; i++) {
+			_update_particle(particles->data()[i], delta);
+		}
+	});
 }
 
 void draw_particles(std::vector<Particle*>* particles) {
@@ -130,13 +126,16 @@ void run_app() {
 	// vector of pointers to Particle objects
 	std::vector<Particle*>* particles = new std::vector<Particle*>(5000);
 
+	// every random number the particles need in one vectorized fill
+	std::vector<float> uniforms(particles->size() * 6);
+	mathlib::Xoshiro128x8 random(std::time(NULL), 0);
+	random.fill(uniforms.data(), uniforms.size());
+
 	for (unsigned int index = 0; index < particles->size(); index++) {
-		// update the randomizer seed
-		std::srand( index );
 		// create a new particle object and store the pointer
 		Particle* particle = new Particle();
 		// randomize the particle
-		particle->randomize();
+		particle->randomize(&uniforms[index * 6]);
 		// store the particle in the particle array
 		particles->data()[index] = particle;
 	}